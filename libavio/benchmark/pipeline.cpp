@@ -0,0 +1,533 @@
+/********************************************************************
+* libavio/benchmark/pipeline.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+// Runs a number of headless players concurrently against synthetic streams and reports the
+// sustained frame rate, drops, cpu, memory and latency, so that the capacity of a machine can
+// be measured without any cameras or network. Streams are either lavfi test sources or a short
+// generated h264/hevc clip that each player loops in real time, as a camera would deliver it.
+//
+//     avio_pipeline_bench --streams 16 --source h264 --size 1920x1080 --motion --seconds 30
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+#include "Player.hpp"
+#include "Scheduler.hpp"
+#include "Batch.hpp"
+#include "Trace.hpp"
+#include "Restream.hpp"
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace avio;
+
+struct Options {
+    int streams = 4;
+    std::string source = "lavfi";       // lavfi, h264, hevc, or the path or url of an existing stream
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    int gop = 30;
+    int clip_seconds = 10;
+    float seconds = 20.0f;
+    float warmup = 3.0f;
+    bool realtime = true;
+    bool hidden = false;
+    bool motion = false;
+    bool vectors = false;
+    bool record = false;
+    std::string record_dir = ".";
+    std::string filter = "null";
+    std::string hw;
+    float analytics_fps = 0.0f;
+    std::string trace;
+    int restream_clients = 0;
+    int restream_port = 8554;
+};
+
+static void usage() {
+    std::cout << "Usage: avio_pipeline_bench [options]\n"
+              << "  --streams <n>           concurrent pipelines (4)\n"
+              << "  --source <src>          lavfi, h264, hevc or an existing file or url (lavfi)\n"
+              << "  --size <WxH>            synthetic stream resolution (1280x720)\n"
+              << "  --fps <n>               synthetic stream frame rate (30)\n"
+              << "  --gop <n>               key frame interval of generated clips (30)\n"
+              << "  --seconds <s>           measurement time after warmup (20)\n"
+              << "  --warmup <s>            time excluded from the results (3)\n"
+              << "  --unpaced               read as fast as possible rather than in real time\n"
+              << "  --filter <str>          video filter applied by each player (null)\n"
+              << "  --hw <type>             hardware decoder, e.g. cuda, vaapi, d3d11va\n"
+              << "  --hidden                decode for analysis only, no filter or display stage\n"
+              << "  --motion                enable pixel motion detection\n"
+              << "  --vectors               enable motion vector detection\n"
+              << "  --record <dir>          record every stream into dir\n"
+              << "  --analytics <fps>       letterbox frames for a detector at a shared fps budget\n"
+              << "  --trace <file>          write a chrome trace of the run\n"
+              << "  --restream <n>          serve every stream over loopback http to n clients each, h264 or hevc sources\n"
+              << "  --port <n>              restream port (8554)\n"
+              << std::endl;
+}
+
+static bool parse(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("missing value for " + arg);
+            return argv[++i];
+        };
+        if      (arg == "--streams")   opts.streams = std::stoi(value());
+        else if (arg == "--source")    opts.source = value();
+        else if (arg == "--fps")       opts.fps = std::stoi(value());
+        else if (arg == "--gop")       opts.gop = std::stoi(value());
+        else if (arg == "--seconds")   opts.seconds = std::stof(value());
+        else if (arg == "--warmup")    opts.warmup = std::stof(value());
+        else if (arg == "--unpaced")   opts.realtime = false;
+        else if (arg == "--filter")    opts.filter = value();
+        else if (arg == "--hw")        opts.hw = value();
+        else if (arg == "--hidden")    opts.hidden = true;
+        else if (arg == "--motion")    opts.motion = true;
+        else if (arg == "--vectors")   opts.vectors = true;
+        else if (arg == "--analytics") opts.analytics_fps = std::stof(value());
+        else if (arg == "--trace")     opts.trace = value();
+        else if (arg == "--restream")  opts.restream_clients = std::stoi(value());
+        else if (arg == "--port")      opts.restream_port = std::stoi(value());
+        else if (arg == "--record") {
+            opts.record = true;
+            opts.record_dir = value();
+        }
+        else if (arg == "--size") {
+            std::string size = value();
+            if (sscanf(size.c_str(), "%dx%d", &opts.width, &opts.height) != 2)
+                throw std::runtime_error("invalid size " + size);
+        }
+        else {
+            usage();
+            return false;
+        }
+    }
+    return true;
+}
+
+static void make_clip(const std::string& filename, AVCodecID codec_id, const Options& opts) {
+    // encodes a moving test pattern, motion gives the decoder and the analytics realistic work
+    ExceptionChecker ex;
+    const AVCodec* codec = avcodec_find_encoder(codec_id);
+    if (!codec)
+        throw std::runtime_error(std::string("no encoder available for ") + avcodec_get_name(codec_id));
+
+    AVFormatContext* fmt_ctx = nullptr;
+    AVCodecContext* enc_ctx = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* pkt = nullptr;
+    ex.ck(avformat_alloc_output_context2(&fmt_ctx, nullptr, nullptr, filename.c_str()), AAOC2);
+    AVStream* stream = avformat_new_stream(fmt_ctx, nullptr);
+    ex.ck(enc_ctx = avcodec_alloc_context3(codec), AAC3);
+    enc_ctx->width = opts.width;
+    enc_ctx->height = opts.height;
+    enc_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc_ctx->time_base = av_make_q(1, opts.fps);
+    enc_ctx->framerate = av_make_q(opts.fps, 1);
+    enc_ctx->gop_size = opts.gop;
+    enc_ctx->max_b_frames = 0;
+    enc_ctx->bit_rate = (int64_t)opts.width * opts.height * opts.fps / 10;
+    if (fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    av_opt_set(enc_ctx->priv_data, "preset", "veryfast", 0);
+    ex.ck(avcodec_open2(enc_ctx, codec, nullptr), AO2);
+    ex.ck(avcodec_parameters_from_context(stream->codecpar, enc_ctx), APFC);
+    stream->time_base = enc_ctx->time_base;
+    ex.ck(avio_open(&fmt_ctx->pb, filename.c_str(), AVIO_FLAG_WRITE), AO);
+    ex.ck(avformat_write_header(fmt_ctx, nullptr), AWH);
+
+    ex.ck(frame = av_frame_alloc(), AFA);
+    frame->format = enc_ctx->pix_fmt;
+    frame->width = enc_ctx->width;
+    frame->height = enc_ctx->height;
+    ex.ck(av_frame_get_buffer(frame, 0), AFGB);
+    ex.ck(pkt = av_packet_alloc(), APA);
+
+    int count = opts.clip_seconds * opts.fps;
+    for (int n = 0; n <= count; n++) {
+        AVFrame* input = nullptr;
+        if (n < count) {
+            ex.ck(av_frame_make_writable(frame), AFMW);
+            int box = opts.height / 4;
+            int bx = (n * 8) % std::max(1, opts.width - box);
+            int by = opts.height / 2 - box / 2;
+            for (int y = 0; y < opts.height; y++) {
+                uint8_t* row = frame->data[0] + y * frame->linesize[0];
+                for (int x = 0; x < opts.width; x++)
+                    row[x] = (x >= bx && x < bx + box && y >= by && y < by + box) ? 235 : (uint8_t)((x + y + n * 2) & 0x7f);
+            }
+            for (int y = 0; y < opts.height / 2; y++) {
+                memset(frame->data[1] + y * frame->linesize[1], 128 + ((y + n) & 0x1f), opts.width / 2);
+                memset(frame->data[2] + y * frame->linesize[2], 128 - ((y + n) & 0x1f), opts.width / 2);
+            }
+            frame->pts = n;
+            input = frame;
+        }
+        ex.ck(avcodec_send_frame(enc_ctx, input), ASF);
+        while (true) {
+            int ret = avcodec_receive_packet(enc_ctx, pkt);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                break;
+            ex.ck(ret, ARP);
+            av_packet_rescale_ts(pkt, enc_ctx->time_base, stream->time_base);
+            pkt->stream_index = stream->index;
+            ex.ck(av_interleaved_write_frame(fmt_ctx, pkt), AIWF);
+        }
+    }
+
+    ex.ck(av_write_trailer(fmt_ctx), AWT);
+    avio_closep(&fmt_ctx->pb);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc_ctx);
+    avformat_free_context(fmt_ctx);
+}
+
+static double rss_mb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0.0;
+    return counters.WorkingSetSize / (1024.0 * 1024.0);
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0)
+            return std::stod(line.substr(6)) / 1024.0;
+    }
+    return 0.0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0.0;
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#endif
+}
+
+struct Client {
+    // a loopback viewer of the restream server
+    std::thread* thread = nullptr;
+    std::atomic<int64_t> packets { 0 };
+    std::atomic<int64_t> bytes { 0 };
+    std::atomic<int64_t> first_packet_us { -1 };
+    std::string error;
+};
+
+static std::atomic<bool> clients_running { true };
+
+static int client_interrupt(void*) { return !clients_running; }
+
+static void watch(const std::string& url, Client* client) {
+    int64_t start = steady_us();
+    AVFormatContext* fmt_ctx = avformat_alloc_context();
+    fmt_ctx->interrupt_callback = { client_interrupt, nullptr };
+    int ret = avformat_open_input(&fmt_ctx, url.c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        client->error = "unable to open " + url;
+        return;
+    }
+    AVPacket* pkt = av_packet_alloc();
+    while (clients_running && av_read_frame(fmt_ctx, pkt) >= 0) {
+        if (client->first_packet_us < 0)
+            client->first_packet_us = steady_us() - start;
+        client->packets++;
+        client->bytes += pkt->size;
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&fmt_ctx);
+}
+
+struct Sample {
+    int64_t frames = 0;
+    int64_t dropped = 0;
+    int64_t cpu_us = 0;
+};
+
+static Sample sample(Player* player, bool hidden) {
+    Stats& stats = player->stats;
+    Sample result;
+    result.frames = hidden ? stats.video_decoder.out.load() : stats.display.out.load();
+    for (StageStats* s : { &stats.reader, &stats.video_decoder, &stats.video_filter, &stats.display, &stats.writer }) {
+        result.dropped += s->dropped.load();
+        result.cpu_us += s->cpu_us.load();
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        if (!parse(argc, argv, opts))
+            return 1;
+    }
+    catch (const std::exception& e) {
+        std::cout << "error: " << e.what() << std::endl;
+        usage();
+        return 1;
+    }
+
+    // players are told apart by uri in the scheduler and the trace, so each stream gets its own
+    std::vector<std::string> uris;
+    std::string input_format;
+    bool loop = false;
+    try {
+        if (opts.source == "lavfi") {
+            input_format = "lavfi";
+            for (int i = 0; i < opts.streams; i++) {
+                std::stringstream str;
+                str << "testsrc2=size=" << opts.width << "x" << opts.height << ":rate=" << opts.fps << ":duration=" << 86400 + i;
+                uris.push_back(str.str());
+            }
+        }
+        else if (opts.source == "h264" || opts.source == "hevc") {
+            std::string base = "avio_bench_" + opts.source + "_" + std::to_string(opts.width) + "x" + std::to_string(opts.height);
+            std::cout << "generating " << base << ".mp4" << std::endl;
+            make_clip(base + ".mp4", opts.source == "h264" ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC, opts);
+            for (int i = 0; i < opts.streams; i++) {
+                uris.push_back(base + "_" + std::to_string(i) + ".mp4");
+                std::filesystem::copy_file(base + ".mp4", uris.back(), std::filesystem::copy_options::overwrite_existing);
+            }
+            loop = true;
+        }
+        else {
+            loop = std::filesystem::is_regular_file(opts.source);
+            for (int i = 0; i < opts.streams; i++)
+                uris.push_back(opts.source);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cout << "unable to create the test stream: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (opts.trace.length())
+        Trace::enabled = true;
+
+    Scheduler* scheduler = nullptr;
+    std::thread* analytics_thread = nullptr;
+    std::atomic<int64_t> analyzed { 0 };
+    if (opts.analytics_fps > 0) {
+        scheduler = new Scheduler(opts.analytics_fps);
+        analytics_thread = new std::thread([&] {
+            Batch batch(640, 640, true, 0, 1);
+            std::string source;
+            Frame f;
+            while (scheduler->next(source, f)) {
+                batch.prepare({ f });
+                analyzed++;
+            }
+        });
+    }
+
+    std::atomic<int> running { 0 };
+    std::atomic<int> failed { 0 };
+    std::vector<Player*> players;
+    for (int i = 0; i < opts.streams; i++) {
+        Player* player = new Player(uris[i]);
+        player->input_format = input_format;
+        player->headless = true;
+        player->live_stream = true;
+        player->realtime = opts.realtime;
+        player->loop = loop;
+        player->disable_audio = true;
+        player->hidden = opts.hidden;
+        player->request_reconnect = false;
+        player->str_video_filter = opts.filter;
+        player->str_hw_device_type = opts.hw;
+        player->motion_detect = opts.motion;
+        player->motion_vectors = opts.vectors;
+        player->shared_ingest = opts.restream_clients > 0;
+        if (scheduler) player->setScheduler(scheduler);
+        std::string name = "stream " + std::to_string(i);
+        player->mediaPlayingStarted = [&, player, i](const std::string&) {
+            running++;
+            if (opts.record)
+                player->toggleRecording(opts.record_dir + "/avio_bench_" + std::to_string(i));
+        };
+        player->mediaPlayingStopped = [&](const std::string&) { running--; };
+        player->errorCallback = [&, name](const std::string& msg, const std::string&, bool) {
+            std::cout << name << " error: " << msg << std::endl;
+            failed++;
+        };
+        players.push_back(player);
+        player->start();
+    }
+
+    std::vector<Sample> start(players.size());
+    std::vector<int64_t> start_bytes;
+    auto sleep = [](float seconds) { std::this_thread::sleep_for(std::chrono::milliseconds((int)(seconds * 1000))); };
+
+    Restream* restream = nullptr;
+    std::vector<Client*> clients;
+    if (opts.restream_clients > 0) {
+        // the players hold the hubs, the server and its clients share them over loopback
+        sleep(1.0f);
+        std::string address = "http://127.0.0.1:" + std::to_string(opts.restream_port);
+        restream = new Restream(address);
+        for (int i = 0; i < opts.streams; i++)
+            restream->add("/stream" + std::to_string(i), uris[i]);
+        restream->start();
+        for (int i = 0; i < opts.streams; i++) {
+            for (int j = 0; j < opts.restream_clients; j++) {
+                Client* client = new Client();
+                std::string url = address + "/stream" + std::to_string(i);
+                client->thread = new std::thread([url, client] { watch(url, client); });
+                clients.push_back(client);
+            }
+        }
+    }
+
+    sleep(opts.warmup);
+    for (size_t i = 0; i < players.size(); i++) {
+        start[i] = sample(players[i], opts.hidden);
+        players[i]->stats.latency.reset();
+    }
+    for (Client* client : clients)
+        start_bytes.push_back(client->bytes);
+    int64_t start_cpu = process_cpu_us();
+    int64_t start_analyzed = analyzed;
+    auto start_time = std::chrono::steady_clock::now();
+    std::cout << running << " of " << opts.streams << " streams running, measuring for " << opts.seconds << " seconds" << std::endl;
+
+    sleep(opts.seconds);
+    float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count();
+    int64_t total_cpu = process_cpu_us() - start_cpu;
+    double rss = rss_mb();
+
+    std::cout << std::endl << std::left << std::setw(8) << "stream" << std::right
+              << std::setw(10) << "fps" << std::setw(10) << "dropped" << std::setw(10) << "cpu %"
+              << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+    double total_fps = 0.0;
+    int64_t total_dropped = 0;
+    Histogram latency;
+    for (size_t i = 0; i < players.size(); i++) {
+        Sample end = sample(players[i], opts.hidden);
+        Histogram& h = players[i]->stats.latency;
+        double fps = (end.frames - start[i].frames) / elapsed;
+        int64_t dropped = end.dropped - start[i].dropped;
+        double cpu = 100.0 * (end.cpu_us - start[i].cpu_us) / (elapsed * 1000000.0);
+        total_fps += fps;
+        total_dropped += dropped;
+        for (int b = 0; b < Histogram::SIZE; b++)
+            latency.counts[b] += h.counts[b].load();
+        latency.total += h.total.load();
+        latency.max = std::max(latency.max.load(), h.max.load());
+        std::cout << std::left << std::setw(8) << i << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << fps << std::setw(10) << dropped << std::setw(10) << cpu
+                  << std::setw(10) << h.percentile(50) / 1000.0 << std::setw(10) << h.percentile(90) / 1000.0
+                  << std::setw(10) << h.percentile(99) / 1000.0 << std::setw(10) << h.max / 1000.0 << std::endl;
+    }
+
+    std::cout << std::endl
+              << "streams running     " << running << " of " << opts.streams << (failed ? " (" + std::to_string(failed) + " failed)" : "") << std::endl
+              << "total fps           " << total_fps << " (" << total_fps / std::max(1, opts.streams) << " per stream)" << std::endl
+              << "dropped frames      " << total_dropped << std::endl
+              << "process cpu         " << 100.0 * total_cpu / (elapsed * 1000000.0) << " % of one core ("
+              << 100.0 * total_cpu / (elapsed * 1000000.0) / std::max(1, opts.streams) << " per stream)" << std::endl
+              << "resident memory     " << rss << " MB" << std::endl
+              << "latency ms          p50 " << latency.percentile(50) / 1000.0 << "  p90 " << latency.percentile(90) / 1000.0
+              << "  p99 " << latency.percentile(99) / 1000.0 << "  max " << latency.max / 1000.0 << std::endl;
+    if (restream) {
+        int connected = 0;
+        double first_packet_ms = 0.0;
+        int64_t bytes = 0;
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (clients[i]->first_packet_us >= 0) {
+                connected++;
+                first_packet_ms += clients[i]->first_packet_us / 1000.0;
+            }
+            else if (clients[i]->error.length()) {
+                std::cout << clients[i]->error << std::endl;
+            }
+            bytes += clients[i]->bytes - start_bytes[i];
+        }
+        int64_t dropped = 0;
+        for (auto& connection : restream->connections())
+            dropped += std::stoll(connection["dropped"]);
+        std::cout << "restream clients    " << connected << " of " << clients.size() << " receiving, first packet after "
+                  << (connected ? first_packet_ms / connected : 0.0) << " ms" << std::endl
+                  << "restream output     " << bytes * 8 / (elapsed * 1000000.0) << " Mbit/s, " << dropped << " packets dropped" << std::endl;
+    }
+    if (scheduler)
+        std::cout << "analytics fps       " << (analyzed - start_analyzed) / elapsed << " of a " << opts.analytics_fps << " fps budget" << std::endl;
+
+    if (restream) {
+        clients_running = false;
+        for (Client* client : clients) {
+            client->thread->join();
+            delete client->thread;
+            delete client;
+        }
+        restream->stop();
+        delete restream;
+    }
+
+    for (Player* player : players)
+        player->terminate();
+    for (int i = 0; i < 500 && running > 0; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    if (scheduler) {
+        scheduler->close();
+        analytics_thread->join();
+        delete analytics_thread;
+        delete scheduler;
+    }
+
+    if (opts.trace.length()) {
+        try {
+            Trace::dump(opts.trace);
+            std::cout << "trace written to " << opts.trace << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // players still shutting down keep their objects, the process is about to exit anyway
+    if (running == 0)
+        for (Player* player : players) delete player;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+/********************************************************************
+* libavio/benchmark/primitives.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+// Microbenchmarks of the primitives on the per packet and per frame paths. Sizes follow what a
+// camera delivers, 1080p frames, packets of tens of kilobytes, 30 fps video with 48 kHz audio.
+//
+//     avio_primitives_bench --benchmark_filter=Queue
+
+#include <thread>
+#include <vector>
+#include <cstring>
+
+#include <benchmark/benchmark.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+}
+
+#include "Player.hpp"
+
+using namespace avio;
+
+static Packet make_packet(int size, int stream_index=0, int64_t pts=0, bool key=false) {
+    AVPacket* raw = av_packet_alloc();
+    av_new_packet(raw, size);
+    memset(raw->data, 0x5a, size);
+    raw->stream_index = stream_index;
+    raw->pts = raw->dts = pts;
+    if (key) raw->flags |= AV_PKT_FLAG_KEY;
+    Packet pkt(raw);
+    av_packet_free(&raw);
+    return pkt;
+}
+
+static Frame make_frame(int width, int height) {
+    Frame f;
+    f.frame->format = AV_PIX_FMT_YUV420P;
+    f.frame->width = width;
+    f.frame->height = height;
+    av_frame_get_buffer(f.frame, 0);
+    return f;
+}
+
+static Reader* make_reader() {
+    // a lavfi source gives real stream time bases, 1/30 video and 1/48000 audio, without any files
+    static Reader* reader = new Reader("testsrc2=size=320x240:rate=30[out0];sine=sample_rate=48000[out1]", "lavfi");
+    return reader;
+}
+
+// Queue
+
+static void BM_QueuePushPop(benchmark::State& state) {
+    Queue<Packet> queue(128);
+    Packet pkt = make_packet(1024);
+    for (auto _ : state) {
+        queue.push(Packet(pkt));
+        benchmark::DoNotOptimize(queue.pop());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueuePushPop);
+
+static void BM_QueueProducerConsumer(benchmark::State& state) {
+    // one consumer thread drains the queue while the benchmark thread pushes, as reader and decoder do
+    const int64_t capacity = state.range(0);
+    const int batch = 1024;
+    Packet pkt = make_packet(16384);
+    for (auto _ : state) {
+        Queue<Packet> queue(capacity);
+        std::thread consumer([&] {
+            for (int i = 0; i < batch; i++)
+                benchmark::DoNotOptimize(queue.pop());
+        });
+        for (int i = 0; i < batch; i++)
+            queue.push(Packet(pkt));
+        consumer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_QueueProducerConsumer)->Arg(1)->Arg(8)->Arg(128)->UseRealTime();
+
+static void BM_QueueContended(benchmark::State& state) {
+    // many threads sharing one queue, e.g. the analysis workers of a scheduler
+    static Queue<int> queue;
+    for (auto _ : state) {
+        queue.push(1);
+        benchmark::DoNotOptimize(queue.pop());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueueContended)->ThreadRange(1, 16)->UseRealTime();
+
+static void BM_QueueTryPushFull(benchmark::State& state) {
+    // cost of a drop, the path a stalled analyzer puts on the decoder
+    Queue<Frame> queue(1);
+    queue.push(Frame(nullptr));
+    Frame f(nullptr);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(queue.try_push(Frame(f)));
+}
+BENCHMARK(BM_QueueTryPushFull);
+
+// Packet and Frame
+
+static void BM_PacketFromRaw(benchmark::State& state) {
+    const int size = state.range(0);
+    AVPacket* raw = av_packet_alloc();
+    for (auto _ : state) {
+        av_new_packet(raw, size);
+        Packet pkt(raw);
+        benchmark::DoNotOptimize(pkt.pkt);
+    }
+    av_packet_free(&raw);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PacketFromRaw)->Arg(512)->Arg(16384)->Arg(262144);
+
+static void BM_PacketCopy(benchmark::State& state) {
+    // copies share the reference counted buffer, the size should make no difference
+    Packet pkt = make_packet(state.range(0));
+    for (auto _ : state) {
+        Packet copy(pkt);
+        benchmark::DoNotOptimize(copy.pkt);
+    }
+}
+BENCHMARK(BM_PacketCopy)->Arg(512)->Arg(262144);
+
+static void BM_PacketMove(benchmark::State& state) {
+    Packet a = make_packet(16384);
+    for (auto _ : state) {
+        Packet b(std::move(a));
+        a = std::move(b);
+        benchmark::DoNotOptimize(a.pkt);
+    }
+}
+BENCHMARK(BM_PacketMove);
+
+static void BM_FrameAlloc(benchmark::State& state) {
+    const int width = state.range(0);
+    const int height = state.range(1);
+    for (auto _ : state) {
+        Frame f = make_frame(width, height);
+        benchmark::DoNotOptimize(f.frame->data[0]);
+    }
+}
+BENCHMARK(BM_FrameAlloc)->Args({ 640, 360 })->Args({ 1920, 1080 })->Args({ 3840, 2160 });
+
+static void BM_FrameCopy(benchmark::State& state) {
+    Frame f = make_frame(1920, 1080);
+    for (auto _ : state) {
+        Frame copy(f);
+        benchmark::DoNotOptimize(copy.frame);
+    }
+}
+BENCHMARK(BM_FrameCopy);
+
+static void BM_FrameMove(benchmark::State& state) {
+    Frame a = make_frame(1920, 1080);
+    for (auto _ : state) {
+        Frame b(std::move(a));
+        a = std::move(b);
+        benchmark::DoNotOptimize(a.frame);
+    }
+}
+BENCHMARK(BM_FrameMove);
+
+// Reader time conversions
+
+static void BM_ReaderRealTime(benchmark::State& state) {
+    Reader* reader = make_reader();
+    int64_t pts = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(reader->real_time(reader->video_stream_index, pts));
+        pts += 1;
+    }
+}
+BENCHMARK(BM_ReaderRealTime);
+
+static void BM_ReaderPtsFromRealTime(benchmark::State& state) {
+    Reader* reader = make_reader();
+    int64_t ms = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(reader->pts_from_real_time(reader->audio_stream_index, ms));
+        ms += 33;
+    }
+}
+BENCHMARK(BM_ReaderPtsFromRealTime);
+
+// Writer pre record cache
+
+static void BM_WriterPushCachePkt(benchmark::State& state) {
+    // steady state of a 30 fps camera with 48 kHz audio, every push past the first key frame
+    // trims the cache back to the configured duration, range is the gop length in frames
+    Reader* reader = make_reader();
+    reader->cache_size_in_seconds = state.range(1);
+    const int gop = state.range(0);
+    Writer writer(reader);
+    Packet video = make_packet(16384, reader->video_stream_index);
+    Packet audio = make_packet(512, reader->audio_stream_index);
+    int64_t n = 0;
+    for (auto _ : state) {
+        Packet v(video);
+        v.pkt->pts = v.pkt->dts = n;
+        if (n % gop == 0) v.pkt->flags |= AV_PKT_FLAG_KEY;
+        writer.push_cache_pkt(std::move(v));
+        for (int i = 0; i < 2; i++) {
+            Packet a(audio);
+            a.pkt->pts = a.pkt->dts = n * 1600 + i * 800;
+            writer.push_cache_pkt(std::move(a));
+        }
+        n++;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["video_cache"] = writer.video_cache.size();
+}
+BENCHMARK(BM_WriterPushCachePkt)->Args({ 30, 1 })->Args({ 30, 10 })->Args({ 300, 10 });
+
+// Audio conversion, the same swr configuration as Audio for a 48 kHz stereo aac stream
+
+static void BM_AudioConvert(benchmark::State& state) {
+    const int samples = state.range(0);
+    AVChannelLayout layout;
+    av_channel_layout_default(&layout, 2);
+    SwrContext* swr_ctx = swr_alloc();
+    swr_alloc_set_opts2(&swr_ctx, &layout, AV_SAMPLE_FMT_S16, 48000, &layout, AV_SAMPLE_FMT_FLTP, 48000, 0, NULL);
+    swr_init(swr_ctx);
+
+    Frame f;
+    f.frame->format = AV_SAMPLE_FMT_FLTP;
+    f.frame->sample_rate = 48000;
+    f.frame->nb_samples = samples;
+    av_channel_layout_copy(&f.frame->ch_layout, &layout);
+    av_frame_get_buffer(f.frame, 0);
+    for (int c = 0; c < 2; c++) {
+        float* data = (float*)f.frame->data[c];
+        for (int i = 0; i < samples; i++)
+            data[i] = (float)((i % 96) - 48) / 48.0f;
+    }
+
+    int size = av_samples_get_buffer_size(NULL, 2, samples, AV_SAMPLE_FMT_S16, 0);
+    uint8_t* buffer = (uint8_t*)malloc(size);
+    for (auto _ : state) {
+        const uint8_t** data = (const uint8_t**)&f.frame->data[0];
+        benchmark::DoNotOptimize(swr_convert(swr_ctx, &buffer, samples, data, samples));
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    free(buffer);
+    swr_free(&swr_ctx);
+}
+BENCHMARK(BM_AudioConvert)->Arg(1024)->Arg(2048);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,124 @@
+/********************************************************************
+* libavio/include/Activity.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef ACTIVITY_HPP
+#define ACTIVITY_HPP
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#include "Queue.hpp"
+
+namespace avio {
+
+// Estimates scene activity from compressed packet sizes alone. A predicted frame has to
+// code whatever changed since its reference, so its size tracks the amount of motion.
+// Sizes are compared against a baseline built from the median predicted frame size of
+// previous GOPs, which keeps the estimate independent of bitrate and resolution.
+
+struct ActivitySample {
+    int size = -1;
+    bool key_frame = false;
+};
+
+class Activity {
+public:
+    std::string uri;
+    Queue<ActivitySample> samples;
+    int gain = 50;
+    float smoothing = 0.5f;     // weight of the previous ratio in the per packet average
+    float quiet_rate = 0.2f;    // baseline adaptation while the scene is quiet
+    float busy_rate = 0.02f;    // slow adaptation while active so a lasting change is eventually absorbed
+    size_t max_gop = 300;       // streams with very long or no GOPs are evaluated in windows of this size
+    std::atomic<float> level { 0.0f };
+    int64_t samples_dropped = 0;
+
+    double baseline = 0.0;
+    double ratio = 0.0;
+    std::vector<int> gop;
+
+    std::function<void(float level, const std::string& uri)> motionCallback = nullptr;
+
+    Activity(const std::string& uri) : uri(uri), samples(256) { }
+
+    void push(int size, bool key_frame) {
+        ActivitySample sample;
+        sample.size = size;
+        sample.key_frame = key_frame;
+        if (!samples.try_push(std::move(sample)))
+            samples_dropped++;
+    }
+
+    void close() {
+        samples.clear();
+        samples.push(ActivitySample());
+    }
+
+    int estimate() {
+        ActivitySample sample = samples.pop();
+        if (sample.size < 0)
+            return 0;
+
+        if (sample.key_frame || gop.size() >= max_gop) {
+            end_gop();
+            if (sample.key_frame)
+                return 1;
+        }
+
+        gop.push_back(sample.size);
+
+        // nothing is reported until one full GOP has established the baseline
+        if (baseline <= 0.0)
+            return 1;
+
+        ratio = smoothing * ratio + (1.0 - smoothing) * (sample.size / baseline);
+        float result = std::exp(0.2f * (gain - 50)) * (float)std::max(0.0, ratio - 1.0);
+
+        level = result;
+        if (motionCallback) motionCallback(result, uri);
+        return 1;
+    }
+
+    void end_gop() {
+        if (gop.size() < 3) {
+            gop.clear();
+            return;
+        }
+        auto mid = gop.begin() + gop.size() / 2;
+        std::nth_element(gop.begin(), mid, gop.end());
+        double median = *mid;
+        if (baseline <= 0.0) {
+            baseline = median;
+            ratio = 1.0;
+        }
+        else {
+            double rate = (level < 1.0f) ? quiet_rate : busy_rate;
+            baseline = (1.0 - rate) * baseline + rate * median;
+        }
+        gop.clear();
+    }
+};
+
+}
+
+#endif // ACTIVITY_HPP
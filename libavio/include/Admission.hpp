@@ -0,0 +1,227 @@
+/********************************************************************
+* libavio/include/Admission.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "Stats.hpp"
+
+namespace avio {
+
+// Host wide load shedding for the video decoders. Every player shares one controller, which
+// watches the process cpu and the depth of each decoder's packet queue. Under pressure it steps
+// the lowest priority streams down first, from decoding everything, to skipping non reference
+// frames, to decoding key frames only, and steps the highest priority streams back up first
+// once the load has eased. Decoders only change level at a key frame so a gop is never cut,
+// and the recording of a stream is never affected. Each player has a slot of its own, so a
+// main stream and a wall tile of the same camera are shed independently.
+
+enum ShedLevel {
+    SHED_NONE = 0,
+    SHED_NON_REFERENCE = 1,
+    SHED_KEY_FRAMES = 2
+};
+
+static int nal_length_size(const AVCodecParameters* par) {
+    // zero for annex b streams as delivered by rtsp, otherwise the length prefix size from avcC or hvcC
+    if (!par->extradata || par->extradata[0] != 1)
+        return 0;
+    if (par->codec_id == AV_CODEC_ID_H264 && par->extradata_size >= 7)
+        return (par->extradata[4] & 3) + 1;
+    if (par->codec_id == AV_CODEC_ID_HEVC && par->extradata_size >= 23)
+        return (par->extradata[21] & 3) + 1;
+    return 0;
+}
+
+static int nal_reference(const uint8_t* nal, int size, AVCodecID codec_id) {
+    // 1 for a reference slice, 0 for a non reference slice, -1 for anything that is not a slice
+    if (size < 1) return -1;
+    if (codec_id == AV_CODEC_ID_H264) {
+        int type = nal[0] & 0x1f;
+        if (type < 1 || type > 5) return -1;
+        return (nal[0] >> 5) & 3 ? 1 : 0;
+    }
+    if (codec_id == AV_CODEC_ID_HEVC) {
+        int type = (nal[0] >> 1) & 0x3f;
+        if (type > 31) return -1;
+        // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and the reserved RSV_VCL_N types are even numbers below 16
+        return (type <= 14 && !(type & 1)) ? 0 : 1;
+    }
+    return 1;
+}
+
+static bool is_reference(const uint8_t* data, int size, AVCodecID codec_id, int length_size) {
+    // true unless every slice in the packet is marked as unused for reference, which includes
+    // packets holding only parameter sets or sei and all codecs other than h264 and hevc
+    if (codec_id != AV_CODEC_ID_H264 && codec_id != AV_CODEC_ID_HEVC)
+        return true;
+    bool found = false;
+    if (length_size) {
+        int i = 0;
+        while (i + length_size <= size) {
+            int n = 0;
+            for (int k = 0; k < length_size; k++)
+                n = (n << 8) | data[i + k];
+            i += length_size;
+            if (n <= 0 || i + n > size) break;
+            int ref = nal_reference(data + i, n, codec_id);
+            if (ref == 1) return true;
+            if (ref == 0) found = true;
+            i += n;
+        }
+    }
+    else {
+        for (int i = 0; i + 3 < size; i++) {
+            if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+                int ref = nal_reference(data + i + 3, size - i - 3, codec_id);
+                if (ref == 1) return true;
+                if (ref == 0) found = true;
+                i += 2;
+            }
+        }
+    }
+    return !found;
+}
+
+class AdmissionSlot {
+public:
+    int handle = 0;
+    std::string uri;
+    int priority = 0;
+    std::atomic<int> level { SHED_NONE };         // requested by the controller, applied by the decoder at the next key frame
+    std::atomic<float> queue_fill { 0.0f };
+};
+
+class Admission {
+public:
+    float max_cpu = 0.85f;          // fraction of all cores above which streams are shed
+    float min_cpu = 0.65f;          // fraction below which shed streams are restored
+    float max_queue = 0.5f;         // fill of a decoder packet queue that counts as pressure on its own
+    int interval_ms = 1000;         // one stream changes by one level per interval at most
+
+    std::map<int, std::unique_ptr<AdmissionSlot>> slots;       // one per player, so streams of the same camera are kept apart
+    int next_handle = 1;
+    std::atomic<int64_t> next_evaluation { 0 };
+    int64_t last_wall = 0;
+    int64_t last_cpu = 0;
+    std::atomic<float> cpu { 0.0f };
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::mutex mutex;
+
+    int add(const std::string& uri, int priority=0) {
+        // the handle is given back to remove and set_priority, the player keeps the priority across a reconnect
+        std::lock_guard<std::mutex> lock(mutex);
+        AdmissionSlot* slot = new AdmissionSlot();
+        slot->handle = next_handle++;
+        slot->uri = uri;
+        slot->priority = priority;
+        slots[slot->handle].reset(slot);
+        return slot->handle;
+    }
+
+    AdmissionSlot* get(int handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = slots.find(handle);
+        return it != slots.end() ? it->second.get() : nullptr;
+    }
+
+    void remove(int handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots.erase(handle);
+    }
+
+    void set_priority(int handle, int priority) {
+        // the focused camera should have the highest priority, it is shed last and restored first
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = slots.find(handle);
+        if (it != slots.end())
+            it->second->priority = priority;
+    }
+
+    void evaluate() {
+        // called by the decoders as they work, whichever one arrives after the interval does the evaluation
+        int64_t now = steady_us();
+        if (now < next_evaluation.load(std::memory_order_relaxed))
+            return;
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || now < next_evaluation.load())
+            return;
+        next_evaluation = now + interval_ms * 1000;
+
+        int64_t process = process_cpu_us();
+        if (last_wall) {
+            float usage = (float)(process - last_cpu) / ((now - last_wall) * (float)cores);
+            cpu.store(usage, std::memory_order_relaxed);
+        }
+        last_wall = now;
+        last_cpu = process;
+
+        bool congested = false;
+        for (auto& [handle, slot] : slots) {
+            if (slot->level < SHED_KEY_FRAMES && slot->queue_fill > max_queue)
+                congested = true;
+        }
+
+        if (cpu > max_cpu || congested) {
+            AdmissionSlot* target = nullptr;
+            for (auto& [handle, slot] : slots) {
+                if (slot->level >= SHED_KEY_FRAMES) continue;
+                if (!target || slot->priority < target->priority ||
+                        (slot->priority == target->priority && slot->level < target->level))
+                    target = slot.get();
+            }
+            if (target) target->level++;
+        }
+        else if (cpu < min_cpu) {
+            AdmissionSlot* target = nullptr;
+            for (auto& [handle, slot] : slots) {
+                if (slot->level <= SHED_NONE) continue;
+                if (!target || slot->priority > target->priority ||
+                        (slot->priority == target->priority && slot->level > target->level))
+                    target = slot.get();
+            }
+            if (target) target->level--;
+        }
+    }
+
+    std::vector<std::pair<std::string, int>> levels() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::pair<std::string, int>> result;
+        for (auto& [handle, slot] : slots)
+            result.push_back({ slot->uri, slot->level });
+        return result;
+    }
+};
+
+}
+
+#endif // ADMISSION_HPP
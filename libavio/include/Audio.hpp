@@ -55,6 +55,7 @@ public:
     bool mute = false;
     bool closed = false;
     int audio_driver_index = 0; 
+    StageStats* stats = nullptr;
 
     
     std::function<void(const Frame&, const std::string& uri)> pyAudioCallback = nullptr;
@@ -83,6 +84,8 @@ void callback(void* user_data, uint8_t* output_buffer, int output_length) {
     if (audio->reader->paused) 
         return;
 
+    AVIO_TRACE("audio_callback", audio->reader->uri);
+
     try {
         if (audio->temp_size != output_length) {
             if (audio->temp) free(audio->temp);
@@ -97,7 +100,9 @@ void callback(void* user_data, uint8_t* output_buffer, int output_length) {
                 if (audio->reader->live_stream)
                     audio->reader->audio_pkts->remove_latency();
 
+                if (audio->stats) audio->stats->queue_depth(audio->frames->size());
                 Frame f = audio->frames->pop();
+                if (audio->stats && !f.is_null()) audio->stats->in++;
 
                 if (f.is_null() || audio->reader->terminated) {
                     audio->closed = true;
@@ -131,6 +136,10 @@ void callback(void* user_data, uint8_t* output_buffer, int output_length) {
                     int accum = output_length - avail;
                     memcpy(audio->temp + accum, audio->buffer, to_write);
                     avail -= to_write;
+                    if (audio->stats) {
+                        audio->stats->out++;
+                        audio->stats->update_cpu();
+                    }
                 }
 
                 if (audio->pyAudioCallback) {
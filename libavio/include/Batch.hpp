@@ -0,0 +1,210 @@
+/********************************************************************
+* libavio/include/Batch.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+extern "C" {
+#include <libswscale/swscale.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "Frame.hpp"
+#include "Exception.hpp"
+#include "ThreadPool.hpp"
+
+namespace avio {
+
+// Letterboxes frames from several streams into a single NCHW tensor so that one inference
+// call can serve all of them. Each image is resized with its aspect ratio preserved and the
+// remainder of its slot is filled with the pad value. Boxes found by the model map back to
+// the source frame with (x - offset_x) / scale.
+
+struct Letterbox {
+    float scale = 0.0f;
+    int offset_x = 0;
+    int offset_y = 0;
+    int width = 0;              // size of the source frame
+    int height = 0;
+    int64_t pts = AV_NOPTS_VALUE;
+    bool valid = false;
+};
+
+class Batch {
+public:
+    int width = 640;
+    int height = 640;
+    bool as_float = true;
+    bool bgr = false;
+    bool center = false;        // yolox expects the image in the top left corner
+    int pad_value = 114;
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    float stddev[3] = { 1.0f, 1.0f, 1.0f };
+
+    int capacity = 8;           // the tensor is allocated once for this many images, so arrays over it stay valid
+    int count = 0;
+    std::vector<uint8_t> buffer;
+    std::vector<Letterbox> info;
+    std::vector<SwsContext*> contexts;
+    std::vector<std::vector<uint8_t>> scratch;
+    ThreadPool pool;
+    std::mutex mutex;
+    ExceptionChecker ex;
+
+    Batch(int width=640, int height=640, bool as_float=true, int threads=0, int capacity=8) :
+        width(width), height(height), as_float(as_float), capacity(capacity), pool(threads)
+    {
+        if (width <= 0 || height <= 0 || capacity <= 0)
+            throw std::runtime_error("batch dimensions must be positive");
+        buffer.assign(capacity * slot_size(), 0);
+        contexts.resize(capacity, nullptr);
+        scratch.resize(capacity);
+    }
+
+    ~Batch() {
+        for (SwsContext* ctx : contexts)
+            if (ctx) sws_freeContext(ctx);
+    }
+
+    size_t element_size() const { return as_float ? sizeof(float) : sizeof(uint8_t); }
+    size_t plane_size()   const { return (size_t)width * height; }
+    size_t slot_size()    const { return 3 * plane_size() * element_size(); }
+
+    void set_normalization(const std::vector<float>& m, const std::vector<float>& s) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int c = 0; c < 3; c++) {
+            mean[c] = (c < (int)m.size()) ? m[c] : 0.0f;
+            stddev[c] = (c < (int)s.size() && s[c] != 0.0f) ? s[c] : 1.0f;
+        }
+    }
+
+    // null frames produce a padded slot marked invalid so that the batch keeps its camera order
+    void prepare(const std::vector<Frame>& frames) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int n = (int)frames.size();
+        if (n > capacity)
+            throw std::runtime_error("batch of " + std::to_string(n) + " frames is larger than its capacity of " + std::to_string(capacity));
+        count = n;
+        info.assign(n, Letterbox());
+
+        pool.parallel_for(n, [&](int i) { letterbox(i, frames[i]); });
+    }
+
+    void letterbox(int i, const Frame& f) {
+        Letterbox& box = info[i];
+        uint8_t* slot = buffer.data() + i * slot_size();
+
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)f.format());
+        if (f.is_null() || !f.width() || !f.height() || !desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            pad(slot, 0, 0, 0, 0);
+            return;
+        }
+
+        try {
+            float r = std::min((float)width / f.width(), (float)height / f.height());
+            int w = std::max(1, std::min(width, (int)(f.width() * r)));
+            int h = std::max(1, std::min(height, (int)(f.height() * r)));
+            int x = center ? (width - w) / 2 : 0;
+            int y = center ? (height - h) / 2 : 0;
+
+            ex.ck(contexts[i] = sws_getCachedContext(contexts[i], f.width(), f.height(), (AVPixelFormat)f.format(),
+                    w, h, AV_PIX_FMT_GBRP, SWS_BILINEAR, nullptr, nullptr, nullptr), SGC);
+
+            // swscale writes planar gbr, the planes are routed to the requested channel order
+            int order[3];
+            order[0] = 1;
+            order[1] = bgr ? 0 : 2;
+            order[2] = bgr ? 2 : 0;
+
+            if (as_float) {
+                std::vector<uint8_t>& tmp = scratch[i];
+                int stride = (w + 31) & ~31;
+                tmp.resize((size_t)3 * stride * h);
+                uint8_t* dst[4] = { tmp.data(), tmp.data() + (size_t)stride * h, tmp.data() + (size_t)2 * stride * h, nullptr };
+                int dst_stride[4] = { stride, stride, stride, 0 };
+                ex.ck(sws_scale(contexts[i], f.frame->data, f.frame->linesize, 0, f.height(), dst, dst_stride), SS);
+
+                for (int p = 0; p < 3; p++) {
+                    int c = order[p];
+                    float a = 1.0f / stddev[c];
+                    float b = -mean[c] / stddev[c];
+                    float* plane = (float*)slot + c * plane_size();
+                    for (int row = 0; row < h; row++) {
+                        const uint8_t* src = dst[p] + (size_t)row * stride;
+                        float* out = plane + (size_t)(y + row) * width + x;
+                        for (int col = 0; col < w; col++)
+                            out[col] = src[col] * a + b;
+                    }
+                }
+            }
+            else {
+                // the scaler writes directly into the tensor, the row stride steps over the padding
+                uint8_t* dst[4] = { nullptr, nullptr, nullptr, nullptr };
+                for (int p = 0; p < 3; p++)
+                    dst[p] = slot + order[p] * plane_size() + (size_t)y * width + x;
+                int dst_stride[4] = { width, width, width, 0 };
+                ex.ck(sws_scale(contexts[i], f.frame->data, f.frame->linesize, 0, f.height(), dst, dst_stride), SS);
+            }
+
+            pad(slot, x, y, w, h);
+            box.scale = r;
+            box.offset_x = x;
+            box.offset_y = y;
+            box.width = f.width();
+            box.height = f.height();
+            box.pts = f.pts();
+            box.valid = true;
+        }
+        catch (const std::exception& e) {
+            std::cout << "batch preprocess error: " << e.what() << std::endl;
+            pad(slot, 0, 0, 0, 0);
+        }
+    }
+
+    void pad(uint8_t* slot, int x, int y, int w, int h) {
+        // fills everything in the slot outside of the image rectangle
+        for (int c = 0; c < 3; c++) {
+            for (int row = 0; row < height; row++) {
+                bool inside = row >= y && row < y + h;
+                int begin = inside ? x : 0;
+                int end = inside ? x + w : 0;
+                if (as_float) {
+                    float v = (pad_value - mean[c]) / stddev[c];
+                    float* line = (float*)slot + c * plane_size() + (size_t)row * width;
+                    std::fill(line, line + begin, v);
+                    std::fill(line + end, line + width, v);
+                }
+                else {
+                    uint8_t* line = slot + c * plane_size() + (size_t)row * width;
+                    std::fill(line, line + begin, (uint8_t)pad_value);
+                    std::fill(line + end, line + width, (uint8_t)pad_value);
+                }
+            }
+        }
+    }
+};
+
+}
+
+#endif // BATCH_HPP
@@ -0,0 +1,363 @@
+/********************************************************************
+* libavio/include/Capture.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+namespace avio {
+
+// Capture files hold the demuxed packets of a stream exactly as they arrived, along with the
+// stream parameters and extradata needed to decode them, so that a camera's bitstream can be
+// replayed through the pipeline later without the camera. The layout is little endian
+//
+//     header   "AVIOCAP" 0x01, int32 stream count, then the parameters of each stream
+//     packet   int64 arrival us, int32 stream, int64 pts, dts, duration, int32 flags, int32 size, data
+//
+// A capture that was cut short by a crash is still readable up to its last complete packet.
+
+static const char CAPTURE_MAGIC[8] = { 'A', 'V', 'I', 'O', 'C', 'A', 'P', 0x01 };
+
+class Capture {
+public:
+    std::string filename;
+    std::ofstream file;
+    int64_t start = AV_NOPTS_VALUE;
+    int64_t packets = 0;
+    int64_t bytes = 0;
+
+    Capture(const std::string& filename, AVFormatContext* fmt_ctx) : filename(filename) {
+        file.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            throw std::runtime_error("unable to open capture file " + filename);
+        file.write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+        put<int32_t>(fmt_ctx->nb_streams);
+        for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++)
+            write_stream(fmt_ctx->streams[i]);
+        file.flush();
+    }
+
+    ~Capture() { close(); }
+
+    template <typename T>
+    void put(T value) {
+        file.write((const char*)&value, sizeof(T));
+    }
+
+    void write_stream(const AVStream* stream) {
+        const AVCodecParameters* par = stream->codecpar;
+        put<int32_t>(par->codec_type);
+        put<int32_t>(par->codec_id);
+        put<uint32_t>(par->codec_tag);
+        put<int32_t>(par->format);
+        put<int64_t>(par->bit_rate);
+        put<int32_t>(par->bits_per_coded_sample);
+        put<int32_t>(par->bits_per_raw_sample);
+        put<int32_t>(par->profile);
+        put<int32_t>(par->level);
+        put<int32_t>(par->width);
+        put<int32_t>(par->height);
+        put<AVRational>(par->sample_aspect_ratio);
+        put<int32_t>(par->field_order);
+        put<int32_t>(par->color_range);
+        put<int32_t>(par->color_primaries);
+        put<int32_t>(par->color_trc);
+        put<int32_t>(par->color_space);
+        put<int32_t>(par->chroma_location);
+        put<int32_t>(par->video_delay);
+        put<int32_t>(par->ch_layout.order);
+        put<int32_t>(par->ch_layout.nb_channels);
+        put<uint64_t>(par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ? par->ch_layout.u.mask : 0);
+        put<int32_t>(par->sample_rate);
+        put<int32_t>(par->block_align);
+        put<int32_t>(par->frame_size);
+        put<int32_t>(par->initial_padding);
+        put<AVRational>(stream->time_base);
+        put<AVRational>(stream->avg_frame_rate);
+        put<AVRational>(stream->r_frame_rate);
+        put<int64_t>(stream->start_time);
+        put<int32_t>(par->extradata_size);
+        if (par->extradata_size)
+            file.write((const char*)par->extradata, par->extradata_size);
+    }
+
+    void write(const AVPacket* pkt) {
+        // arrival times are relative to the first packet so that replay can reproduce the jitter
+        int64_t now = av_gettime_relative();
+        if (start == AV_NOPTS_VALUE) start = now;
+        put<int64_t>(now - start);
+        put<int32_t>(pkt->stream_index);
+        put<int64_t>(pkt->pts);
+        put<int64_t>(pkt->dts);
+        put<int64_t>(pkt->duration);
+        put<int32_t>(pkt->flags);
+        put<int32_t>(pkt->size);
+        if (pkt->size)
+            file.write((const char*)pkt->data, pkt->size);
+        packets++;
+        bytes += pkt->size;
+    }
+
+    void close() {
+        if (file.is_open()) file.close();
+    }
+};
+
+class Replay {
+public:
+    struct Record {
+        int64_t offset;     // file position of the packet data
+        int64_t arrival;
+        int32_t stream_index;
+        int64_t pts;
+        int64_t dts;
+        int64_t duration;
+        int32_t flags;
+        int32_t size;
+    };
+
+    struct StreamInfo {
+        AVCodecParameters* codecpar = nullptr;
+        AVRational time_base;
+        AVRational avg_frame_rate;
+        AVRational r_frame_rate;
+        int64_t start_time;
+    };
+
+    std::string filename;
+    std::ifstream file;
+    std::vector<StreamInfo> streams;
+    std::vector<Record> records;
+    size_t next = 0;
+    int64_t start_time = AV_NOPTS_VALUE;    // AV_TIME_BASE units
+    int64_t duration = 0;
+    int64_t replay_start = AV_NOPTS_VALUE;
+    int64_t loops = 0;
+    std::atomic<bool> aborted { false };    // ends a paced wait when the reader is terminated
+
+    Replay(const std::string& filename) : filename(filename) {
+        file.open(filename, std::ios::binary);
+        if (!file.is_open())
+            throw std::runtime_error("unable to open capture file " + filename);
+        char magic[sizeof(CAPTURE_MAGIC)];
+        file.read(magic, sizeof(magic));
+        if (!file || memcmp(magic, CAPTURE_MAGIC, sizeof(magic)))
+            throw std::runtime_error(filename + " is not an avio capture file");
+        int32_t count = get<int32_t>();
+        if (count <= 0 || count > 64)
+            throw std::runtime_error(filename + " has an invalid stream count");
+        for (int i = 0; i < count; i++)
+            read_stream();
+        index();
+    }
+
+    ~Replay() {
+        for (StreamInfo& s : streams)
+            avcodec_parameters_free(&s.codecpar);
+    }
+
+    template <typename T>
+    T get() {
+        T value;
+        if (!file.read((char*)&value, sizeof(T)))
+            throw std::runtime_error(filename + " is truncated");
+        return value;
+    }
+
+    void read_stream() {
+        StreamInfo s;
+        if (!(s.codecpar = avcodec_parameters_alloc()))
+            throw std::runtime_error("avcodec_parameters_alloc failed");
+        streams.push_back(s);
+        AVCodecParameters* par = s.codecpar;
+        par->codec_type = (AVMediaType)get<int32_t>();
+        par->codec_id = (AVCodecID)get<int32_t>();
+        par->codec_tag = get<uint32_t>();
+        par->format = get<int32_t>();
+        par->bit_rate = get<int64_t>();
+        par->bits_per_coded_sample = get<int32_t>();
+        par->bits_per_raw_sample = get<int32_t>();
+        par->profile = get<int32_t>();
+        par->level = get<int32_t>();
+        par->width = get<int32_t>();
+        par->height = get<int32_t>();
+        par->sample_aspect_ratio = get<AVRational>();
+        par->field_order = (AVFieldOrder)get<int32_t>();
+        par->color_range = (AVColorRange)get<int32_t>();
+        par->color_primaries = (AVColorPrimaries)get<int32_t>();
+        par->color_trc = (AVColorTransferCharacteristic)get<int32_t>();
+        par->color_space = (AVColorSpace)get<int32_t>();
+        par->chroma_location = (AVChromaLocation)get<int32_t>();
+        par->video_delay = get<int32_t>();
+        AVChannelOrder order = (AVChannelOrder)get<int32_t>();
+        int32_t nb_channels = get<int32_t>();
+        uint64_t mask = get<uint64_t>();
+        if (order == AV_CHANNEL_ORDER_NATIVE)
+            av_channel_layout_from_mask(&par->ch_layout, mask);
+        else if (nb_channels > 0)
+            av_channel_layout_default(&par->ch_layout, nb_channels);
+        par->sample_rate = get<int32_t>();
+        par->block_align = get<int32_t>();
+        par->frame_size = get<int32_t>();
+        par->initial_padding = get<int32_t>();
+        streams.back().time_base = get<AVRational>();
+        streams.back().avg_frame_rate = get<AVRational>();
+        streams.back().r_frame_rate = get<AVRational>();
+        streams.back().start_time = get<int64_t>();
+        int32_t extradata_size = get<int32_t>();
+        if (extradata_size < 0 || extradata_size > (1 << 24))
+            throw std::runtime_error(filename + " has invalid extradata");
+        if (extradata_size) {
+            if (!(par->extradata = (uint8_t*)av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE)))
+                throw std::runtime_error("extradata allocation failed");
+            par->extradata_size = extradata_size;
+            if (!file.read((char*)par->extradata, extradata_size))
+                throw std::runtime_error(filename + " is truncated");
+        }
+    }
+
+    void index() {
+        // one pass over the packet headers, finds the extent of the timestamps for looping
+        int64_t first = INT64_MAX, last = INT64_MIN;
+        int64_t position = file.tellg();
+        file.seekg(0, std::ios::end);
+        int64_t file_size = file.tellg();
+        file.seekg(position);
+        while (true) {
+            Record r;
+            if (!file.read((char*)&r.arrival, sizeof(r.arrival))) break;
+            if (!file.read((char*)&r.stream_index, sizeof(r.stream_index))) break;
+            if (!file.read((char*)&r.pts, sizeof(r.pts))) break;
+            if (!file.read((char*)&r.dts, sizeof(r.dts))) break;
+            if (!file.read((char*)&r.duration, sizeof(r.duration))) break;
+            if (!file.read((char*)&r.flags, sizeof(r.flags))) break;
+            if (!file.read((char*)&r.size, sizeof(r.size))) break;
+            if (r.stream_index < 0 || (size_t)r.stream_index >= streams.size() || r.size < 0) break;
+            r.offset = file.tellg();
+            if (r.offset + r.size > file_size) break;
+            file.seekg(r.size, std::ios::cur);
+            records.push_back(r);
+
+            if (r.pts != AV_NOPTS_VALUE) {
+                AVRational tb = streams[r.stream_index].time_base;
+                first = std::min(first, av_rescale_q(r.pts, tb, AV_TIME_BASE_Q));
+                last = std::max(last, av_rescale_q(r.pts + std::max<int64_t>(r.duration, 0), tb, AV_TIME_BASE_Q));
+            }
+        }
+        file.clear();
+        if (first <= last) {
+            start_time = first;
+            duration = std::max<int64_t>(last - first, 1);
+        }
+    }
+
+    AVFormatContext* context() {
+        // a demuxer free context, it carries the stream parameters that the rest of the pipeline reads
+        AVFormatContext* fmt_ctx = avformat_alloc_context();
+        if (!fmt_ctx)
+            throw std::runtime_error("avformat_alloc_context failed");
+        for (StreamInfo& s : streams) {
+            AVStream* stream = avformat_new_stream(fmt_ctx, nullptr);
+            if (!stream || avcodec_parameters_copy(stream->codecpar, s.codecpar) < 0) {
+                avformat_free_context(fmt_ctx);
+                throw std::runtime_error("unable to create replay stream");
+            }
+            stream->time_base = s.time_base;
+            stream->avg_frame_rate = s.avg_frame_rate;
+            stream->r_frame_rate = s.r_frame_rate;
+            stream->start_time = s.start_time;
+        }
+        fmt_ctx->start_time = start_time;
+        fmt_ctx->duration = records.size() ? duration : AV_NOPTS_VALUE;
+        return fmt_ctx;
+    }
+
+    int read(AVPacket* pkt, bool paced) {
+        // paced replay reproduces the original arrival times, otherwise packets come as fast as they are taken
+        if (next >= records.size())
+            return AVERROR_EOF;
+        const Record& r = records[next++];
+        if (paced) {
+            int64_t now = av_gettime_relative();
+            if (replay_start == AV_NOPTS_VALUE || next == 1)
+                replay_start = now - r.arrival;
+            // gaps of any length are kept, the wait is sliced so that it can be aborted
+            int64_t delay = replay_start + r.arrival - now;
+            while (delay > 0 && !aborted) {
+                std::this_thread::sleep_for(std::chrono::microseconds(std::min<int64_t>(delay, 100000)));
+                delay = replay_start + r.arrival - av_gettime_relative();
+            }
+            if (aborted)
+                return AVERROR_EXIT;
+        }
+        int ret = av_new_packet(pkt, r.size);
+        if (ret < 0)
+            return ret;
+        file.clear();
+        file.seekg(r.offset);
+        if (r.size && !file.read((char*)pkt->data, r.size)) {
+            av_packet_unref(pkt);
+            return AVERROR_EOF;
+        }
+        pkt->stream_index = r.stream_index;
+        pkt->pts = r.pts;
+        pkt->dts = r.dts;
+        pkt->duration = r.duration;
+        pkt->flags = r.flags;
+        return 0;
+    }
+
+    void seek(int stream_index, int64_t pts) {
+        // restarts from the last key frame of the stream at or before pts
+        size_t result = 0;
+        for (size_t i = 0; i < records.size(); i++) {
+            const Record& r = records[i];
+            if (r.stream_index != stream_index || !(r.flags & AV_PKT_FLAG_KEY) || r.pts == AV_NOPTS_VALUE)
+                continue;
+            if (r.pts > pts)
+                break;
+            result = i;
+        }
+        next = result;
+        replay_start = AV_NOPTS_VALUE;
+    }
+
+    void rewind() {
+        next = 0;
+        loops++;
+    }
+};
+
+}
+
+#endif // CAPTURE_HPP
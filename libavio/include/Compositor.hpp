@@ -0,0 +1,274 @@
+/********************************************************************
+* libavio/include/Compositor.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef COMPOSITOR_HPP
+#define COMPOSITOR_HPP
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include <libswscale/swscale.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "Frame.hpp"
+#include "Exception.hpp"
+#include "ThreadPool.hpp"
+
+namespace avio {
+
+// Builds the camera wall in one rgb24 canvas. The layout is a rectangle for each tile, and
+// each paint scales the latest frame of every stream into its rectangle across a thread pool,
+// with the aspect ratio kept and the rest of the rectangle filled with the background. A tile
+// is only drawn again when its frame or its rectangle has changed, and dirty() lists the tiles
+// drawn by the last compose so that the caller can limit its own update to them.
+
+struct CompositorTile {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    const uint8_t* data = nullptr;      // identifies the frame drawn last, with its pts and size
+    int64_t pts = AV_NOPTS_VALUE;
+    int frame_width = 0;
+    int frame_height = 0;
+    bool drawn = false;
+    SwsContext* sws_ctx = nullptr;
+    std::vector<uint8_t> scratch;
+};
+
+class Compositor {
+public:
+    int width = 0;
+    int height = 0;
+    bool keep_aspect = true;
+    uint8_t background[3] = { 0, 0, 0 };
+
+    std::vector<uint8_t> canvas;
+    std::vector<CompositorTile> tiles;
+    std::vector<std::vector<int>> layout;
+    std::vector<int> updated;
+    bool cleared = false;               // areas outside of the current tiles were repainted with the background
+    bool full = false;                  // the last compose has to be shown in full
+    ThreadPool pool;
+    std::mutex mutex;
+    ExceptionChecker ex;
+
+    Compositor(int width, int height, int threads=0) : pool(threads) {
+        resize(width, height);
+    }
+
+    ~Compositor() {
+        for (CompositorTile& tile : tiles)
+            if (tile.sws_ctx) sws_freeContext(tile.sws_ctx);
+    }
+
+    int stride() const { return width * 3; }
+
+    void resize(int w, int h) {
+        // the canvas is allocated again, so arrays over the old one are no longer valid, and the
+        // tiles are clamped to the new size
+        std::lock_guard<std::mutex> lock(mutex);
+        if (w <= 0 || h <= 0)
+            throw std::runtime_error("compositor dimensions must be positive");
+        if (w == width && h == height)
+            return;
+        width = w;
+        height = h;
+        canvas.assign((size_t)width * height * 3, 0);
+        fill(0, 0, width, height);
+        cleared = true;
+        for (size_t i = 0; i < tiles.size(); i++) {
+            place(tiles[i], layout[i]);
+            tiles[i].drawn = false;
+        }
+    }
+
+    void set_background(int r, int g, int b) {
+        std::lock_guard<std::mutex> lock(mutex);
+        background[0] = (uint8_t)r;
+        background[1] = (uint8_t)g;
+        background[2] = (uint8_t)b;
+        fill(0, 0, width, height);
+        cleared = true;
+        for (CompositorTile& tile : tiles)
+            tile.drawn = false;
+    }
+
+    void set_layout(const std::vector<std::vector<int>>& rects) {
+        // one x, y, width, height rectangle per tile in the order the frames are given to compose,
+        // tiles keep their contents when their rectangle is unchanged
+        for (const std::vector<int>& rect : rects) {
+            if (rect.size() < 4)
+                throw std::runtime_error("compositor layout rectangles must be x, y, width, height");
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = rects.size(); i < tiles.size(); i++) {
+            if (tiles[i].drawn) {
+                fill(tiles[i].x, tiles[i].y, tiles[i].width, tiles[i].height);
+                cleared = true;
+            }
+            if (tiles[i].sws_ctx) sws_freeContext(tiles[i].sws_ctx);
+        }
+        tiles.resize(rects.size());
+        layout = rects;
+        for (size_t i = 0; i < rects.size(); i++) {
+            CompositorTile& tile = tiles[i];
+            int x = tile.x, y = tile.y, w = tile.width, h = tile.height;
+            place(tile, rects[i]);
+            if (tile.x == x && tile.y == y && tile.width == w && tile.height == h)
+                continue;
+            if (tile.drawn) {
+                fill(x, y, w, h);
+                cleared = true;
+            }
+            tile.drawn = false;
+        }
+    }
+
+    void place(CompositorTile& tile, const std::vector<int>& rect) {
+        // the requested rectangle is kept so that a resize can clamp it again
+        tile.x = std::clamp(rect[0], 0, width);
+        tile.y = std::clamp(rect[1], 0, height);
+        tile.width = std::clamp(rect[2], 0, width - tile.x);
+        tile.height = std::clamp(rect[3], 0, height - tile.y);
+    }
+
+    int compose(const std::vector<Frame>& frames) {
+        // returns the number of tiles drawn, zero means the canvas is the same as after the last call
+        // unless the size, background or layout were changed in between
+        std::lock_guard<std::mutex> lock(mutex);
+        updated.clear();
+        full = cleared;
+        cleared = false;
+        int n = std::min((int)frames.size(), (int)tiles.size());
+        for (int i = 0; i < n; i++) {
+            const CompositorTile& tile = tiles[i];
+            const Frame& f = frames[i];
+            bool empty = f.is_null() || !f.width() || !f.height();
+            if (!tile.drawn || (empty ? tile.data != nullptr : (f.frame->data[0] != tile.data || f.pts() != tile.pts ||
+                    f.width() != tile.frame_width || f.height() != tile.frame_height)))
+                updated.push_back(i);
+        }
+        for (int i = n; i < (int)tiles.size(); i++) {
+            if (!tiles[i].drawn || tiles[i].data) updated.push_back(i);
+        }
+
+        static const Frame none(nullptr);
+        pool.parallel_for((int)updated.size(), [&](int k) {
+            int i = updated[k];
+            draw(tiles[i], i < n ? frames[i] : none);
+        });
+        return (int)updated.size();
+    }
+
+    std::vector<int> dirty() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return updated;
+    }
+
+    std::vector<std::vector<int>> dirty_rects() {
+        // the whole canvas after a change of size, background or layout
+        std::lock_guard<std::mutex> lock(mutex);
+        if (full)
+            return { { 0, 0, width, height } };
+        std::vector<std::vector<int>> result;
+        for (int i : updated)
+            result.push_back({ tiles[i].x, tiles[i].y, tiles[i].width, tiles[i].height });
+        return result;
+    }
+
+    void draw(CompositorTile& tile, const Frame& f) {
+        tile.drawn = true;
+        tile.data = nullptr;
+        tile.pts = AV_NOPTS_VALUE;
+        if (!tile.width || !tile.height)
+            return;
+
+        const AVPixFmtDescriptor* desc = f.is_null() ? nullptr : av_pix_fmt_desc_get((AVPixelFormat)f.format());
+        if (f.is_null() || !f.width() || !f.height() || !desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            fill(tile.x, tile.y, tile.width, tile.height);
+            return;
+        }
+
+        try {
+            int w = tile.width;
+            int h = tile.height;
+            if (keep_aspect) {
+                float r = std::min((float)tile.width / f.width(), (float)tile.height / f.height());
+                w = std::clamp((int)(f.width() * r + 0.5f), 1, tile.width);
+                h = std::clamp((int)(f.height() * r + 0.5f), 1, tile.height);
+            }
+            int x = tile.x + (tile.width - w) / 2;
+            int y = tile.y + (tile.height - h) / 2;
+
+            // the scaler only takes its simd paths for aligned rows, which a tile inside the canvas
+            // seldom has, so it writes to the tile's own buffer and the rows are copied across
+            ex.ck(tile.sws_ctx = sws_getCachedContext(tile.sws_ctx, f.width(), f.height(), (AVPixelFormat)f.format(),
+                    w, h, AV_PIX_FMT_RGB24, SWS_BILINEAR, nullptr, nullptr, nullptr), SGC);
+            int line = (w * 3 + 63) & ~63;
+            tile.scratch.resize((size_t)line * h + 64);
+            uint8_t* aligned = tile.scratch.data() + ((64 - ((uintptr_t)tile.scratch.data() & 63)) & 63);
+            uint8_t* dst[4] = { aligned, nullptr, nullptr, nullptr };
+            int dst_stride[4] = { line, 0, 0, 0 };
+            ex.ck(sws_scale(tile.sws_ctx, f.frame->data, f.frame->linesize, 0, f.height(), dst, dst_stride), SS);
+            for (int row = 0; row < h; row++)
+                memcpy(canvas.data() + (size_t)(y + row) * stride() + x * 3, aligned + (size_t)row * line, w * 3);
+
+            fill(tile.x, tile.y, tile.width, y - tile.y);
+            fill(tile.x, y + h, tile.width, tile.y + tile.height - y - h);
+            fill(tile.x, y, x - tile.x, h);
+            fill(x + w, y, tile.x + tile.width - x - w, h);
+
+            tile.data = f.frame->data[0];
+            tile.pts = f.pts();
+            tile.frame_width = f.width();
+            tile.frame_height = f.height();
+        }
+        catch (const std::exception& e) {
+            std::cout << "compositor error: " << e.what() << std::endl;
+            fill(tile.x, tile.y, tile.width, tile.height);
+        }
+    }
+
+    void fill(int x, int y, int w, int h) {
+        if (w <= 0 || h <= 0) return;
+        for (int row = y; row < y + h; row++) {
+            uint8_t* line = canvas.data() + (size_t)row * stride() + x * 3;
+            if (background[0] == background[1] && background[1] == background[2]) {
+                std::fill(line, line + w * 3, background[0]);
+            }
+            else {
+                for (int col = 0; col < w; col++) {
+                    line[col * 3 + 0] = background[0];
+                    line[col * 3 + 1] = background[1];
+                    line[col * 3 + 2] = background[2];
+                }
+            }
+        }
+    }
+};
+
+}
+
+#endif // COMPOSITOR_HPP
@@ -21,6 +21,7 @@
 #define DECODER_HPP
 
 #include <iostream>
+#include <atomic>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -31,6 +32,9 @@ extern "C" {
 #include "Queue.hpp"
 #include "Packet.hpp"
 #include "Frame.hpp"
+#include "Tap.hpp"
+#include "Stats.hpp"
+#include "Admission.hpp"
 
 AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
 
@@ -56,6 +60,8 @@ public:
     Queue<Packet>* pkts = nullptr;
     Queue<Frame>* frames = nullptr;
     Queue<Packet>* writer_pkts = nullptr;
+    std::vector<Tap*> taps;
+    StageStats* stats = nullptr;
     Reader* reader = nullptr;
     AVFrame* av_frame = nullptr;
     AVFrame* sw_frame = nullptr;
@@ -64,8 +70,16 @@ public:
     std::string str_media_type;
     AVHWDeviceType hw_type;
     AVBufferRef* hw_device_ctx = nullptr;
+    Admission* admission = nullptr;
+    AdmissionSlot* slot = nullptr;
+    int shed_level = SHED_NONE;
+    int nal_length = 0;
+    std::function<bool()> demand = nullptr;     // false while nothing uses the output of the decoder
+    bool idle = false;
+    std::atomic<int> skip_request { 0 };
+    int skip = 0;                               // packets to skip before a key frame is decoded, negative for any key frame
 
-    Decoder(Reader* reader, AVMediaType media_type, Queue<Packet>* pkts, Queue<Frame>* frames, AVHWDeviceType hw_type=AV_HWDEVICE_TYPE_NONE) 
+    Decoder(Reader* reader, AVMediaType media_type, Queue<Packet>* pkts, Queue<Frame>* frames, AVHWDeviceType hw_type=AV_HWDEVICE_TYPE_NONE, bool export_mvs=false) 
             : reader(reader), media_type(media_type), pkts(pkts), frames(frames), hw_type(hw_type) {
 
         const char* str = av_get_media_type_string(media_type);
@@ -90,6 +104,10 @@ public:
         
         ex.ck((codec_ctx = avcodec_alloc_context3(decoder)), AAC3);
         ex.ck(avcodec_parameters_to_context(codec_ctx, stream->codecpar), APTC);
+        nal_length = nal_length_size(stream->codecpar);
+
+        if (export_mvs)
+            codec_ctx->export_side_data |= AV_CODEC_EXPORT_DATA_MVS;
 
         if (hw_type != AV_HWDEVICE_TYPE_NONE) {
             codec_ctx->get_format = get_hw_format;
@@ -113,8 +131,11 @@ public:
         Packet pkt = pkts->pop();
 
         if (reader->terminated) {
-            frames->clear();
-            frames->push(Frame(nullptr));
+            if (frames) {
+                frames->clear();
+                frames->push(Frame(nullptr));
+            }
+            for (Tap* tap : taps) tap->close();
             if (writer_pkts) writer_pkts->push(Packet(nullptr));
             return 0;
         }
@@ -123,6 +144,8 @@ public:
             if (pkt.pkt->data) {
                 if (!strcmp((const char*)pkt.pkt->data, "FLUSH"))
                     avcodec_flush_buffers(codec_ctx);
+                else if (!strcmp((const char*)pkt.pkt->data, "GAP"))
+                    skip = -1;
             }
             return 1;
         }
@@ -130,22 +153,50 @@ public:
         if (reader->seek_pts != AV_NOPTS_VALUE) 
             return 1;
 
+        if (stats) {
+            if (!pkt.is_null()) stats->in++;
+            stats->queue_depth(pkts->size() + 1);
+        }
+
+        if (!pkt.is_null() && !wanted(pkt)) {
+            // idle decoders still pass their packets on to the recording
+            if (stats) stats->skipped++;
+            if (writer_pkts) writer_pkts->push(std::move(pkt));
+            return 1;
+        }
+
+        if (!pkt.is_null() && skipping(pkt)) {
+            // so are the packets skipped to catch up with the stream
+            if (stats) stats->dropped++;
+            if (writer_pkts) writer_pkts->push(std::move(pkt));
+            return 1;
+        }
+
+        if (!pkt.is_null() && !admit(pkt)) {
+            // shed packets are still recorded, they only skip the decoder
+            if (stats) stats->dropped++;
+            if (writer_pkts) writer_pkts->push(std::move(pkt));
+            return 1;
+        }
+
         try {
+            AVIO_TRACE(media_type == AVMEDIA_TYPE_VIDEO ? "video_decode" : "audio_decode", reader->uri);
             int ret = -1;
             ex.ck((ret = avcodec_send_packet(codec_ctx, pkt.pkt)), ASP);
             while ((ret = avcodec_receive_frame(codec_ctx, av_frame)) >= 0) {
                 if (av_frame->format == hw_pix_fmt) {
                     ex.ck(av_hwframe_transfer_data(sw_frame, av_frame, 0), AHTD);
                 	ex.ck(av_frame_copy_props(sw_frame, av_frame), AFCP);
-                    frames->push(Frame(sw_frame));
+                    deliver(Frame(sw_frame));
                     Frame term(av_frame);
                 }
                 else {
-                    frames->push(Frame(av_frame));
+                    deliver(Frame(av_frame));
                 }
             }
             if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
                 ex.ck(ret, "error during decoding");
+            if (stats) stats->update_cpu();
         }
         catch (const std::exception& e) {
             std::stringstream str;
@@ -154,7 +205,8 @@ public:
         }
 
         if (pkt.is_null()) {
-            frames->push(Frame(nullptr));
+            if (frames) frames->push(Frame(nullptr));
+            for (Tap* tap : taps) tap->close();
             if (writer_pkts) writer_pkts->push(std::move(pkt));
             return 0;
         }
@@ -165,6 +217,86 @@ public:
 
         return 1;
     }
+
+    bool wanted(const Packet& pkt) {
+        // with no consumer the decoder discards its packets, and the filter after it has nothing
+        // to do, once a consumer attaches again decoding resumes at the next key frame
+        if (!demand) return true;
+        if (!demand()) {
+            if (!idle) {
+                idle = true;
+                avcodec_flush_buffers(codec_ctx);
+                if (reader->infoCallback) reader->infoCallback(str_media_type + " decoder idle", reader->uri);
+            }
+            return false;
+        }
+        if (idle) {
+            if (!pkt.is_key_frame())
+                return false;
+            idle = false;
+            if (reader->infoCallback) reader->infoCallback(str_media_type + " decoder resumed", reader->uri);
+        }
+        return true;
+    }
+
+    int skip_to_key_frame() {
+        // latency recovery from another thread, decoding resumes at the newest queued key frame, or if
+        // there is no newer one, at the next key frame to arrive, returns the number of packets skipped
+        int count = pkts->count_to_last_key_frame();
+        if (count)
+            skip_request = count;
+        return count < 0 ? -count : count;
+    }
+
+    bool skipping(const Packet& pkt) {
+        int request = skip_request.exchange(0);
+        if (request)
+            skip = request;
+        if (!skip)
+            return false;
+        if (skip > 0)
+            skip--;
+        if (pkt.is_key_frame() && skip <= 0) {
+            skip = 0;
+            return false;
+        }
+        if (!skip)
+            skip = -1;
+        return true;
+    }
+
+    bool admit(const Packet& pkt) {
+        // the level requested by the admission controller takes effect at a key frame, so the
+        // decoder never loses a reference it needs, and only whole gops or non reference frames are skipped
+        if (!slot) return true;
+        slot->queue_fill = pkts->max_size > 0 ? (float)pkts->size() / pkts->max_size : 0.0f;
+        admission->evaluate();
+
+        if (pkt.is_key_frame()) {
+            int level = slot->level;
+            if (level != shed_level) {
+                shed_level = level;
+                if (reader->infoCallback) {
+                    const char* names[] = { "off", "non reference frames skipped", "key frames only" };
+                    reader->infoCallback(std::string("load shedding ") + names[level], reader->uri);
+                }
+            }
+            return true;
+        }
+        if (shed_level == SHED_KEY_FRAMES)
+            return false;
+        if (shed_level == SHED_NON_REFERENCE)
+            return is_reference(pkt.pkt->data, pkt.pkt->size, codec_ctx->codec_id, nal_length);
+        return true;
+    }
+
+    void deliver(Frame&& f) {
+        // analytics get a reference to the frame ahead of the filter, a null frames queue means nobody displays it
+        for (Tap* tap : taps) tap->push(f);
+        if (stats) stats->out++;
+        if (media_type == AVMEDIA_TYPE_VIDEO && reader->stats) reader->stats->first_frame();
+        if (frames) frames->push(std::move(f));
+    }
 };
 
 }
@@ -0,0 +1,200 @@
+/********************************************************************
+* libavio/include/Detect.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef DETECT_HPP
+#define DETECT_HPP
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Batch.hpp"
+#include "ThreadPool.hpp"
+
+namespace avio {
+
+// Post processing for the raw yolox head output, laid out as [batch, anchors, 5 + classes]
+// with each anchor holding cx, cy, w, h, objectness and the class scores. The result is the
+// same as yolox.utils.postprocess followed by torchvision batched_nms.
+
+struct Detection {
+    float x1 = 0.0f;
+    float y1 = 0.0f;
+    float x2 = 0.0f;
+    float y2 = 0.0f;
+    float score = 0.0f;
+    int label = -1;
+};
+
+class Detect {
+public:
+    float conf_threshold = 0.3f;
+    float nms_threshold = 0.65f;
+    bool decode = false;        // set when the model was exported with decode_in_inference off
+    int input_width = 640;
+    int input_height = 640;
+    std::vector<int> strides = { 8, 16, 32 };
+    int max_detections = 300;
+
+    struct Anchor { float x, y, stride; };
+    std::vector<Anchor> grid;
+    std::vector<int> grid_key;
+    ThreadPool pool;
+    std::mutex mutex;
+
+    Detect(int threads=0) : pool(threads) { }
+
+    std::vector<std::vector<Detection>> process(const float* data, int batch, int anchors, int channels,
+                                                const std::vector<Letterbox>& info = std::vector<Letterbox>())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (channels < 6)
+            throw std::runtime_error("detector output must have at least one class channel");
+        if (decode)
+            make_grid(anchors);
+
+        std::vector<std::vector<Detection>> result(batch);
+        pool.parallel_for(batch, [&](int i) {
+            const float* image = data + (size_t)i * anchors * channels;
+            result[i] = nms(candidates(image, anchors, channels));
+            if (i < (int)info.size())
+                unletterbox(result[i], info[i]);
+        });
+        return result;
+    }
+
+    void make_grid(int anchors) {
+        std::vector<int> key = { input_width, input_height };
+        key.insert(key.end(), strides.begin(), strides.end());
+        if (key == grid_key && (int)grid.size() == anchors)
+            return;
+
+        grid.clear();
+        for (int stride : strides) {
+            int w = input_width / stride;
+            int h = input_height / stride;
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++)
+                    grid.push_back({ (float)x, (float)y, (float)stride });
+        }
+        grid_key = key;
+        if ((int)grid.size() != anchors) {
+            grid_key.clear();
+            throw std::runtime_error("detector output does not match the input size and strides");
+        }
+    }
+
+    std::vector<Detection> candidates(const float* image, int anchors, int channels) const {
+        std::vector<Detection> list;
+        int num_classes = channels - 5;
+        for (int a = 0; a < anchors; a++) {
+            const float* p = image + (size_t)a * channels;
+
+            // class scores never exceed one, so a low objectness rejects the anchor before the class scan
+            float obj = p[4];
+            if (obj < conf_threshold)
+                continue;
+
+            const float* cls = p + 5;
+            int label = 0;
+            float best = cls[0];
+            for (int c = 1; c < num_classes; c++) {
+                if (cls[c] > best) {
+                    best = cls[c];
+                    label = c;
+                }
+            }
+            float score = obj * best;
+            if (score < conf_threshold)
+                continue;
+
+            float cx = p[0], cy = p[1], w = p[2], h = p[3];
+            if (decode) {
+                const Anchor& g = grid[a];
+                cx = (cx + g.x) * g.stride;
+                cy = (cy + g.y) * g.stride;
+                w = std::exp(w) * g.stride;
+                h = std::exp(h) * g.stride;
+            }
+
+            Detection d;
+            d.x1 = cx - w / 2;
+            d.y1 = cy - h / 2;
+            d.x2 = cx + w / 2;
+            d.y2 = cy + h / 2;
+            d.score = score;
+            d.label = label;
+            list.push_back(d);
+        }
+        return list;
+    }
+
+    std::vector<Detection> nms(std::vector<Detection>&& list) const {
+        // greedy suppression in score order, boxes only suppress others of the same class
+        std::stable_sort(list.begin(), list.end(), [](const Detection& a, const Detection& b) { return a.score > b.score; });
+
+        std::vector<Detection> kept;
+        for (const Detection& d : list) {
+            bool suppressed = false;
+            for (const Detection& k : kept) {
+                if (k.label == d.label && iou(k, d) > nms_threshold) {
+                    suppressed = true;
+                    break;
+                }
+            }
+            if (!suppressed) {
+                kept.push_back(d);
+                if (max_detections > 0 && (int)kept.size() >= max_detections)
+                    break;
+            }
+        }
+        return kept;
+    }
+
+    static float iou(const Detection& a, const Detection& b) {
+        float w = std::min(a.x2, b.x2) - std::max(a.x1, b.x1);
+        float h = std::min(a.y2, b.y2) - std::max(a.y1, b.y1);
+        if (w <= 0.0f || h <= 0.0f)
+            return 0.0f;
+        float inter = w * h;
+        float area_a = (a.x2 - a.x1) * (a.y2 - a.y1);
+        float area_b = (b.x2 - b.x1) * (b.y2 - b.y1);
+        return inter / (area_a + area_b - inter);
+    }
+
+    static void unletterbox(std::vector<Detection>& list, const Letterbox& box) {
+        // maps boxes from model input coordinates back onto the source frame
+        if (!box.valid) {
+            list.clear();
+            return;
+        }
+        for (Detection& d : list) {
+            d.x1 = std::clamp((d.x1 - box.offset_x) / box.scale, 0.0f, (float)box.width);
+            d.y1 = std::clamp((d.y1 - box.offset_y) / box.scale, 0.0f, (float)box.height);
+            d.x2 = std::clamp((d.x2 - box.offset_x) / box.scale, 0.0f, (float)box.width);
+            d.y2 = std::clamp((d.y2 - box.offset_y) / box.scale, 0.0f, (float)box.height);
+        }
+    }
+};
+
+}
+
+#endif // DETECT_HPP
@@ -26,6 +26,8 @@
 #include "Queue.hpp"
 #include "Reader.hpp"
 #include "Filter.hpp"
+#include "Scheduler.hpp"
+#include "Latency.hpp"
 #include "Exception.hpp"
 
 namespace avio {
@@ -38,8 +40,13 @@ public:
     Uint32 sdl_pixel_format = SDL_PIXELFORMAT_UNKNOWN;
 
     Reader* reader = nullptr;
+    Decoder* decoder = nullptr;
     Queue<Frame>* frames = nullptr;
+    Scheduler* scheduler = nullptr;
+    Stats* stats = nullptr;
+    Latency* latency = nullptr;
     Frame last_frame;
+    std::mutex mutex;
     bool one_shot = false;
     ExceptionChecker ex;
     
@@ -71,7 +78,10 @@ public:
 
     void show_frame(const Frame& f) {
         try {
-            if (renderCallback) renderCallback(f, reader->uri);
+            if (renderCallback) {
+                AVIO_TRACE("render_callback", reader->uri);
+                renderCallback(f, reader->uri);
+            }
             if (progressCallback) progressCallback(progress(f.pts()), reader->uri);
 
             if (headless) return;
@@ -87,6 +97,7 @@ public:
                 ex.ck((texture = SDL_CreateTexture(renderer, sdl_pixel_format, SDL_TEXTUREACCESS_STREAMING, f.width(), f.height())), "SDL_CreateTexture", SDL_GetError());               
             }
 
+            AVIO_TRACE("present", reader->uri);
             update_texture(f);
 
             if (SDL_RenderClear(renderer)) error("SDL_RenderClear");
@@ -116,25 +127,47 @@ public:
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
         else {
+            if (stats) stats->display.queue_depth(frames->size());
             Frame f = frames->pop();
 
             if (f.is_null())
                 return 0;
 
-            if (reader->seek_pts != AV_NOPTS_VALUE)
+            if (stats) stats->display.in++;
+
+            if (reader->seek_pts != AV_NOPTS_VALUE) {
+                if (stats) stats->display.dropped++;
                 return 1;
+            }
 
             if (!reader->live_stream)
                 wait(f.pts());
 
             show_frame(f);
+            if (stats) {
+                stats->display.out++;
+                int64_t delay = stats->displayed(f.pts());
+                stats->display.update_cpu();
+                if (latency && decoder && reader->live_stream && delay >= 0 && latency->update(delay))
+                    latency->recovered(decoder->skip_to_key_frame(), reader->uri);
+            }
+            if (scheduler) scheduler->submit(reader->uri, f);
             
+            std::lock_guard<std::mutex> lock(mutex);
             last_frame = std::move(f);
             one_shot = false;
         }
         return 1;
     }
 
+    Frame latest() {
+        // shallow reference to the most recently displayed frame, safe to call from other threads
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!last_frame.width())
+            return Frame(nullptr);
+        return last_frame;
+    }
+
     void wait(int64_t pts) {
         if (reader->has_audio()) {
             int64_t rts = reader->real_time(reader->video_stream_index, pts);
@@ -44,6 +44,8 @@ public:
 	Decoder* decoder = nullptr;
     Queue<Frame>* input = nullptr;
     Queue<Frame>* output = nullptr;
+    std::vector<Tap*> taps;
+    StageStats* stats = nullptr;
 	AVFilterContext* sink_ctx = nullptr;
 	AVFilterContext* src_ctx = nullptr;
 	AVFilterGraph* graph = nullptr;
@@ -106,26 +108,38 @@ public:
         if (decoder->reader->terminated) {
             output->clear();
             output->push(Frame(nullptr));
+            for (Tap* tap : taps) tap->close();
             return 0;
         }
 
         if (f.is_null()) {
             output->push(Frame(nullptr));
+            for (Tap* tap : taps) tap->close();
             return 0; 
         }
 
         if (decoder->reader->seek_pts != AV_NOPTS_VALUE)
             return 1;
 
+        if (stats) {
+            stats->in++;
+            stats->queue_depth(input->size() + 1);
+        }
+
         try {
+            AVIO_TRACE(decoder->media_type == AVMEDIA_TYPE_VIDEO ? "video_filter" : "audio_filter", decoder->reader->uri);
             ex.ck(av_buffersrc_add_frame_flags(src_ctx, f.frame, AV_BUFFERSRC_FLAG_KEEP_REF), ABAFF);
 
             int ret = -1;
             while ((ret = av_buffersink_get_frame(sink_ctx, av_frame)) >= 0) {
-                output->push(Frame(av_frame));
+                Frame filtered(av_frame);
+                for (Tap* tap : taps) tap->push(filtered);
+                output->push(std::move(filtered));
+                if (stats) stats->out++;
             }
             if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
                 ex.ck(ret, "error during filtering");
+            if (stats) stats->update_cpu();
         }
         catch (const std::exception& e) {
             std::stringstream str;
@@ -20,14 +20,76 @@
 #ifndef FRAME_HPP
 #define FRAME_HPP
 
+#include <string>
+#include <algorithm>
+
 extern "C" {
 #include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
 }
 
 #include "Exception.hpp"
 
 namespace avio {
 
+// Layout of one plane of a video frame as rows of values, for handing the plane to numpy
+// without a copy. Components that share a plane, like the interleaved u and v of nv12 or the
+// channels of rgba, are the channels. Planes whose components share bytes or alternate,
+// such as rgb565 or yuyv422, are given as rows of bytes.
+
+struct PlaneShape {
+    int rows = 0;
+    int cols = 0;
+    int channels = 0;
+    int element_size = 0;
+    bool is_float = false;
+};
+
+static PlaneShape plane_shape(int format, int width, int height, int plane) {
+    PlaneShape shape;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM)) ||
+            plane < 0 || plane >= av_pix_fmt_count_planes((AVPixelFormat)format))
+        return shape;
+    int bytes = av_image_get_linesize((AVPixelFormat)format, width, plane);
+    if (bytes <= 0)
+        return shape;
+
+    int step = 0;
+    int bits = 0;
+    int components = 0;
+    bool regular = true;
+    for (int c = 0; c < desc->nb_components; c++) {
+        const AVComponentDescriptor& comp = desc->comp[c];
+        if (comp.plane != plane) continue;
+        int size = comp.depth + comp.shift;
+        size = size > 16 ? 32 : size > 8 ? 16 : 8;
+        if ((step && comp.step != step) || (bits && size != bits) || comp.offset % (size / 8))
+            regular = false;
+        step = comp.step;
+        bits = size;
+        components++;
+    }
+    if (components * bits / 8 > step)
+        regular = false;
+
+    bool chroma = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+    shape.rows = chroma ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+    if (regular && step && bytes % step == 0 && step % (bits / 8) == 0) {
+        shape.element_size = bits / 8;
+        shape.channels = step / shape.element_size;
+        shape.cols = bytes / step;
+        shape.is_float = desc->flags & AV_PIX_FMT_FLAG_FLOAT;
+    }
+    else {
+        shape.element_size = 1;
+        shape.channels = 1;
+        shape.cols = bytes;
+    }
+    return shape;
+}
+
 class Frame {
 public:
     AVFrame* frame = nullptr;
@@ -88,6 +150,23 @@ public:
     int        sample_rate() const { return frame ? frame->sample_rate : 0; }
     int        format()      const { return frame ? frame->format : -1; }
     AVRational time_base()   const { return frame ? frame->time_base : av_make_q(0, 0); }
+
+    int planes() const {
+        // video planes, zero for audio and hardware frames
+        if (!frame || !frame->width) return 0;
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+        if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) return 0;
+        return std::max(0, av_pix_fmt_count_planes((AVPixelFormat)frame->format));
+    }
+
+    PlaneShape plane(int i) const {
+        return frame ? plane_shape(frame->format, frame->width, frame->height, i) : PlaneShape();
+    }
+
+    std::string str_pix_fmt() const {
+        const char* name = (frame && frame->width) ? av_get_pix_fmt_name((AVPixelFormat)frame->format) : nullptr;
+        return name ? name : "none";
+    }
     
 };
 
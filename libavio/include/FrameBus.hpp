@@ -0,0 +1,370 @@
+/********************************************************************
+* libavio/include/FrameBus.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef FRAMEBUS_HPP
+#define FRAMEBUS_HPP
+
+#include <string>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "Tap.hpp"
+#include "Stats.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace avio {
+
+// Decoded frames published to shared memory, so that other local processes can use them
+// without a session of their own with the camera or a decoder of their own. The ring is a
+// header followed by a fixed number of slots, the publisher fills the slots in turn and
+// readers map the same memory and look at the newest one in place. A slot carries the
+// sequence number it was written for, a reader checks it again after using the pixels to
+// know that the publisher has not lapped the ring in the meantime.
+
+static const char FRAMEBUS_MAGIC[8] = { 'A', 'V', 'I', 'O', 'B', 'U', 'S', '1' };
+
+struct FrameBusHeader {
+    char magic[8];
+    uint32_t slots;
+    std::atomic<uint32_t> closed;           // set when the publisher goes away or has to resize the ring
+    uint64_t slot_size;
+    std::atomic<uint64_t> sequence;         // frames published, the newest is in slot (sequence - 1) % slots
+    uint8_t reserved[32];
+};
+
+struct FrameBusSlot {
+    std::atomic<uint64_t> sequence;         // zero while being written
+    int64_t pts;
+    int64_t time_us;                        // steady clock of the publisher when the frame was written
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t linesize[4];
+    uint64_t offset[4];
+    uint64_t size;
+    uint8_t reserved[16];
+};
+
+static const size_t FRAMEBUS_HEADER_SIZE = 128;
+static const size_t FRAMEBUS_SLOT_HEADER_SIZE = 128;
+static_assert(sizeof(FrameBusHeader) <= FRAMEBUS_HEADER_SIZE && sizeof(FrameBusSlot) <= FRAMEBUS_SLOT_HEADER_SIZE, "frame bus layout");
+
+class SharedMemory {
+public:
+    std::string name;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE handle = nullptr;
+#endif
+
+    SharedMemory() { }
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+    ~SharedMemory() { close(); }
+
+    static std::string system_name(const std::string& name) {
+#ifdef _WIN32
+        return "Local\\avio_" + name;
+#else
+        return "/avio_" + name;
+#endif
+    }
+
+    void create(const std::string& arg, size_t length) {
+        close();
+        name = system_name(arg);
+#ifdef _WIN32
+        handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)length >> 32), (DWORD)(length & 0xffffffff), name.c_str());
+        if (!handle)
+            throw std::runtime_error("unable to create shared memory " + name);
+        data = (uint8_t*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, length);
+#else
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0)
+            throw std::runtime_error("unable to create shared memory " + name);
+        if (ftruncate(fd, length)) {
+            ::close(fd);
+            throw std::runtime_error("unable to size shared memory " + name);
+        }
+        void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        data = (ptr == MAP_FAILED) ? nullptr : (uint8_t*)ptr;
+#endif
+        if (!data)
+            throw std::runtime_error("unable to map shared memory " + name);
+        size = length;
+    }
+
+    bool open(const std::string& arg) {
+        // read only, false if nobody is publishing under the name
+        close();
+        name = system_name(arg);
+#ifdef _WIN32
+        handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        if (!handle) return false;
+        data = (uint8_t*)MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info;
+        if (data && VirtualQuery(data, &info, sizeof(info)))
+            size = info.RegionSize;
+#else
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data = (uint8_t*)ptr;
+                size = st.st_size;
+            }
+        }
+        ::close(fd);
+#endif
+        if (!data || size < FRAMEBUS_HEADER_SIZE) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (data) {
+#ifdef _WIN32
+            UnmapViewOfFile(data);
+#else
+            munmap(data, size);
+#endif
+        }
+#ifdef _WIN32
+        if (handle) CloseHandle(handle);
+        handle = nullptr;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    void unlink() {
+#ifndef _WIN32
+        if (name.length()) shm_unlink(name.c_str());
+#endif
+    }
+};
+
+class FrameBus : public Tap {
+public:
+    std::string bus_name;
+    int slots = 4;
+    SharedMemory memory;
+    int64_t published = 0;
+
+    FrameBus(const std::string& bus_name, int slots=4) : Tap("frame bus", ""), bus_name(bus_name), slots(std::max(2, slots)) {
+        filtered = true;
+    }
+
+    ~FrameBus() {
+        if (memory.data) {
+            header()->closed.store(1, std::memory_order_release);
+            memory.close();
+            memory.unlink();
+        }
+    }
+
+    FrameBusHeader* header() { return (FrameBusHeader*)memory.data; }
+    FrameBusSlot* slot(int i) { return (FrameBusSlot*)(memory.data + FRAMEBUS_HEADER_SIZE + i * (FRAMEBUS_SLOT_HEADER_SIZE + header()->slot_size)); }
+
+    void create(size_t slot_size) {
+        // readers of a ring that is replaced see it closed and attach again by name
+        if (memory.data) {
+            header()->closed.store(1, std::memory_order_release);
+            memory.close();
+        }
+        slot_size = (slot_size + 63) & ~(size_t)63;
+        memory.create(bus_name, FRAMEBUS_HEADER_SIZE + slots * (FRAMEBUS_SLOT_HEADER_SIZE + slot_size));
+        memset(memory.data, 0, FRAMEBUS_HEADER_SIZE);
+        FrameBusHeader* h = header();
+        memcpy(h->magic, FRAMEBUS_MAGIC, 8);
+        h->slots = slots;
+        h->slot_size = slot_size;
+        h->sequence.store(0);
+        for (int i = 0; i < slots; i++)
+            slot(i)->sequence.store(0);
+    }
+
+    void analyze(const Frame& f) override {
+        AVPixelFormat format = (AVPixelFormat)f.format();
+        int size = av_image_get_buffer_size(format, f.width(), f.height(), 1);
+        if (size <= 0) return;
+        if (!memory.data || (size_t)size > header()->slot_size)
+            create(size);
+
+        FrameBusHeader* h = header();
+        uint64_t sequence = h->sequence.load(std::memory_order_relaxed) + 1;
+        FrameBusSlot* s = slot((sequence - 1) % h->slots);
+        s->sequence.store(0, std::memory_order_relaxed);
+        // keeps the pixel stores below from being seen ahead of the zero by a reader
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint8_t* base = (uint8_t*)s + FRAMEBUS_SLOT_HEADER_SIZE;
+        uint8_t* data[4] = { nullptr };
+        int linesize[4] = { 0 };
+        ex.ck(av_image_fill_arrays(data, linesize, base, format, f.width(), f.height(), 1), "av_image_fill_arrays");
+        av_image_copy(data, linesize, (const uint8_t**)f.frame->data, f.frame->linesize, format, f.width(), f.height());
+        for (int i = 0; i < 4; i++) {
+            s->linesize[i] = linesize[i];
+            s->offset[i] = data[i] ? data[i] - base : 0;
+        }
+        s->pts = f.pts();
+        s->time_us = steady_us();
+        s->format = format;
+        s->width = f.width();
+        s->height = f.height();
+        s->size = size;
+
+        s->sequence.store(sequence, std::memory_order_release);
+        h->sequence.store(sequence, std::memory_order_release);
+        published++;
+    }
+};
+
+class SharedFrame {
+public:
+    uint64_t sequence = 0;
+    int64_t pts = AV_NOPTS_VALUE;
+    int64_t time_us = 0;
+    int format = AV_PIX_FMT_NONE;
+    int width = 0;
+    int height = 0;
+    int linesize[4] = { 0 };
+    const uint8_t* data[4] = { nullptr };
+    size_t size = 0;
+    const FrameBusSlot* slot = nullptr;
+    std::shared_ptr<SharedMemory> memory;      // keeps the mapping alive while the frame is in use
+
+    bool is_null() const { return !slot; }
+
+    bool valid() const {
+        // true while the publisher has not yet reused the slot, check after reading the pixels
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot && slot->sequence.load(std::memory_order_acquire) == sequence;
+    }
+
+    std::string str_format() const {
+        const char* name = av_get_pix_fmt_name((AVPixelFormat)format);
+        return name ? name : "none";
+    }
+};
+
+class FrameBusReader {
+public:
+    std::string bus_name;
+    std::shared_ptr<SharedMemory> memory;
+    uint64_t last_sequence = 0;
+
+    FrameBusReader(const std::string& bus_name) : bus_name(bus_name) { attach(); }
+
+    bool attach() {
+        // a new mapping each time, frames still held by the caller keep the old one
+        std::shared_ptr<SharedMemory> mapping = std::make_shared<SharedMemory>();
+        memory.reset();
+        if (!mapping->open(bus_name))
+            return false;
+        const FrameBusHeader* h = (const FrameBusHeader*)mapping->data;
+        if (memcmp(h->magic, FRAMEBUS_MAGIC, 8) || !h->slots ||
+                mapping->size < FRAMEBUS_HEADER_SIZE + h->slots * (FRAMEBUS_SLOT_HEADER_SIZE + h->slot_size))
+            return false;
+        memory = mapping;
+        return true;
+    }
+
+    bool attached() const { return memory && !header()->closed.load(std::memory_order_acquire); }
+
+    const FrameBusHeader* header() const { return (const FrameBusHeader*)memory->data; }
+
+    SharedFrame latest() {
+        // the newest frame in place in shared memory, null if there is none or no publisher
+        SharedFrame result;
+        if (!attached() && !attach())
+            return result;
+        const FrameBusHeader* h = header();
+        uint64_t sequence = h->sequence.load(std::memory_order_acquire);
+        if (!sequence)
+            return result;
+        const FrameBusSlot* s = (const FrameBusSlot*)(memory->data + FRAMEBUS_HEADER_SIZE + ((sequence - 1) % h->slots) * (FRAMEBUS_SLOT_HEADER_SIZE + h->slot_size));
+        if (s->sequence.load(std::memory_order_acquire) != sequence)
+            return result;
+        result.sequence = sequence;
+        result.pts = s->pts;
+        result.time_us = s->time_us;
+        result.format = s->format;
+        result.width = s->width;
+        result.height = s->height;
+        result.size = s->size;
+        const uint8_t* base = (const uint8_t*)s + FRAMEBUS_SLOT_HEADER_SIZE;
+        for (int i = 0; i < 4; i++) {
+            result.linesize[i] = s->linesize[i];
+            result.data[i] = s->linesize[i] ? base + s->offset[i] : nullptr;
+        }
+        result.slot = s;
+        result.memory = memory;
+        if (!result.valid())
+            return SharedFrame();
+        last_sequence = sequence;
+        return result;
+    }
+
+    SharedFrame next(int timeout_ms=1000) {
+        // waits for a frame newer than the last one returned, polling since the publisher is in another process
+        int64_t deadline = steady_us() + (int64_t)timeout_ms * 1000;
+        uint64_t previous = last_sequence;
+        while (true) {
+            SharedFrame f = latest();
+            if (!f.is_null() && f.sequence != previous)
+                return f;
+            if (steady_us() > deadline)
+                return SharedFrame();
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+};
+
+}
+
+#endif // FRAMEBUS_HPP
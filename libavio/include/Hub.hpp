@@ -0,0 +1,296 @@
+/********************************************************************
+* libavio/include/Hub.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef HUB_HPP
+#define HUB_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <algorithm>
+
+#include "Reader.hpp"
+#include "Queue.hpp"
+#include "Packet.hpp"
+
+namespace avio {
+
+// One connection to a camera shared by every consumer of its stream. The hub reads packets
+// from a single Reader and hands each subscriber a reference to them in its own bounded queue,
+// so the display, the recorder and any analytics or restream of the same uri cost the camera
+// one session. Subscribers come and go while the hub keeps running, a new one starts at the
+// next key frame. Each subscriber chooses what happens when it falls behind.
+
+enum DropPolicy {
+    DROP_NONE = 0,              // wait for room, a slow subscriber holds up the hub and everyone else
+    DROP_OLDEST = 1,            // discard from the front of the queue to make room
+    DROP_TO_KEY_FRAME = 2       // empty the queue and resume video at the next key frame
+};
+
+class HubSubscriber {
+public:
+    std::string name;
+    Queue<Packet> pkts;
+    int policy = DROP_TO_KEY_FRAME;
+    bool video = true;
+    bool audio = true;
+    bool synced = false;
+    bool primed = false;        // attached with the cached gop
+    bool truncated = false;     // the cached gop was cut short by max_gop, so it was not primed
+    std::atomic<bool> closed { false };
+    std::atomic<int64_t> delivered { 0 };
+    std::atomic<int64_t> dropped { 0 };
+
+    HubSubscriber(const std::string& name, int capacity, int policy) : name(name), pkts(capacity), policy(policy) { }
+
+    void offer(const Packet& p, int video_stream_index, int audio_stream_index) {
+        // called from the hub thread only
+        if (closed) return;
+        bool is_video = p.stream_index() == video_stream_index;
+        bool is_audio = p.stream_index() == audio_stream_index;
+        if ((is_video && !video) || (is_audio && !audio) || (!is_video && !is_audio))
+            return;
+
+        if (!synced) {
+            // audio waits with the video, so that both start together at the first key frame
+            if (video && video_stream_index >= 0 && !(is_video && p.is_key_frame()))
+                return;
+            synced = true;
+        }
+
+        switch (policy) {
+            case DROP_NONE:
+                pkts.push(Packet(p));
+                break;
+            case DROP_OLDEST:
+                while (!pkts.try_push(Packet(p))) {
+                    pkts.erase_front(1);
+                    dropped++;
+                }
+                break;
+            default:
+                if (!pkts.try_push(Packet(p))) {
+                    dropped += pkts.size() + 1;
+                    pkts.clear();
+                    synced = false;
+                    if (is_video && p.is_key_frame()) {
+                        pkts.push(Packet(p));
+                        synced = true;
+                        dropped--;
+                    }
+                    if (!synced) return;
+                }
+        }
+        delivered++;
+    }
+
+    void close() {
+        // ends the stream for the consumer, also unblocks a hub waiting for room
+        closed = true;
+        pkts.clear();
+        pkts.push(Packet(nullptr));
+    }
+};
+
+class Hub {
+public:
+    std::string uri;
+    Reader* reader = nullptr;
+    std::thread* thread = nullptr;
+    std::vector<std::shared_ptr<HubSubscriber>> subscribers;
+    std::vector<Packet> gop;                // packets since the latest key frame, to prime new subscribers
+    int max_gop = 600;
+    int primed = 0;                         // primed subscribers attached, the gop is only cached while there are any
+    bool gop_full = false;                  // packets of the latest gop were left out of the cache
+    std::atomic<bool> closed { false };
+    std::mutex mutex;
+
+    struct Entry {
+        std::weak_ptr<Hub> hub;
+        std::shared_future<std::shared_ptr<Hub>> opening;    // valid while the first caller connects and probes
+    };
+
+    static inline std::mutex registry_mutex;
+    static inline std::map<std::string, Entry> registry;
+
+    static std::shared_ptr<Hub> open(const std::string& uri, const std::string& format="", const ReaderOptions& options=ReaderOptions()) {
+        // the hub for a uri is shared for as long as anybody holds it, and reopened after its stream has ended,
+        // the registry is only locked to look up the entry so that a slow camera does not hold up the others
+        std::promise<std::shared_ptr<Hub>> promise;
+        std::unique_lock<std::mutex> lock(registry_mutex);
+        Entry& entry = registry[uri];
+        std::shared_ptr<Hub> hub = entry.hub.lock();
+        if (hub && !hub->closed)
+            return hub;
+        if (entry.opening.valid()) {
+            // another player is already opening the uri, its result is shared
+            std::shared_future<std::shared_ptr<Hub>> opening = entry.opening;
+            lock.unlock();
+            return opening.get();
+        }
+        entry.opening = promise.get_future().share();
+        lock.unlock();
+
+        try {
+            hub = std::make_shared<Hub>(uri, format, options);
+            lock.lock();
+            registry[uri].hub = hub;
+            registry[uri].opening = std::shared_future<std::shared_ptr<Hub>>();
+            lock.unlock();
+            promise.set_value(hub);
+            return hub;
+        }
+        catch (...) {
+            if (!lock.owns_lock()) lock.lock();
+            registry[uri].opening = std::shared_future<std::shared_ptr<Hub>>();
+            lock.unlock();
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    static std::map<std::string, std::map<std::string, std::map<std::string, double>>> snapshot() {
+        std::map<std::string, std::map<std::string, std::map<std::string, double>>> result;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto& [uri, entry] : registry) {
+            std::shared_ptr<Hub> hub = entry.hub.lock();
+            if (!hub) continue;
+            std::lock_guard<std::mutex> hub_lock(hub->mutex);
+            for (auto& sub : hub->subscribers) {
+                result[uri][sub->name] = {
+                    { "delivered", (double)sub->delivered.load() },
+                    { "dropped", (double)sub->dropped.load() },
+                    { "queued", (double)sub->pkts.size() }
+                };
+            }
+        }
+        return result;
+    }
+
+    Hub(const std::string& uri, const std::string& format, const ReaderOptions& options) : uri(uri) {
+        reader = new Reader(uri, format, options);
+        thread = new std::thread([&] { Trace::set_thread_name("hub " + this->uri); while (ingest()) {} });
+    }
+
+    ~Hub() {
+        closed = true;
+        reader->callback_params.aborted = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& sub : subscribers) sub->close();
+        }
+        if (thread) {
+            thread->join();
+            delete thread;
+        }
+        delete reader;
+    }
+
+    std::shared_ptr<HubSubscriber> attach(const std::string& name, int capacity=128, int policy=DROP_TO_KEY_FRAME, bool prime=false) {
+        // a primed subscriber starts with the latest key frame and what followed it rather than waiting for the next one,
+        // its queue holds the cached packets on top of its capacity, so priming neither drops nor blocks the hub
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<HubSubscriber> sub = std::make_shared<HubSubscriber>(name, prime ? capacity + (int)gop.size() : capacity, policy);
+        if (closed) {
+            sub->close();
+            return sub;
+        }
+        if (prime) {
+            sub->primed = true;
+            primed++;
+            // a gop longer than the cache would decode with a gap, the subscriber waits for the next key frame instead
+            sub->truncated = gop_full;
+            if (!gop_full) {
+                for (const Packet& p : gop)
+                    sub->offer(p, reader->video_stream_index, reader->audio_stream_index);
+            }
+        }
+        subscribers.push_back(sub);
+        return sub;
+    }
+
+    void detach(const std::shared_ptr<HubSubscriber>& sub) {
+        if (!sub) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = std::find(subscribers.begin(), subscribers.end(), sub);
+            if (it != subscribers.end()) {
+                subscribers.erase(it);
+                if (sub->primed && --primed == 0) {
+                    gop.clear();
+                    gop_full = false;
+                }
+            }
+        }
+        sub->close();
+    }
+
+    int ingest() {
+        int ret = 0;
+        {
+            AVIO_TRACE("hub_read", uri);
+            reader->callback_params.arm(reader->options.read_timeout_ms);
+            ret = reader->read_next();
+            if (ret >= 0) reader->prepare_packet();
+        }
+        if (ret < 0 || closed) {
+            if (ret < 0 && ret != AVERROR_EOF && !closed) {
+                char buf[256];
+                av_strerror(ret, buf, 256);
+                std::cout << uri << " hub read exception " << buf << std::endl;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            for (auto& sub : subscribers) sub->close();
+            return 0;
+        }
+
+        Packet p(reader->pkt);
+        std::vector<std::shared_ptr<HubSubscriber>> targets;
+        {
+            // offered outside the lock, so a subscriber that blocks the hub can still be detached
+            std::lock_guard<std::mutex> lock(mutex);
+            targets = subscribers;
+            if (primed) {
+                if (p.stream_index() == reader->video_stream_index && p.is_key_frame()) {
+                    gop.clear();
+                    gop_full = false;
+                }
+                if (!gop.empty() || (p.stream_index() == reader->video_stream_index && p.is_key_frame())) {
+                    if ((int)gop.size() < max_gop) gop.push_back(p);
+                    else gop_full = true;
+                }
+            }
+        }
+        for (auto& sub : targets)
+            sub->offer(p, reader->video_stream_index, reader->audio_stream_index);
+        return 1;
+    }
+
+    AVFormatContext* context() const { return reader->fmt_ctx; }
+};
+
+}
+
+#endif // HUB_HPP
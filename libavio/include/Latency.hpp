@@ -0,0 +1,98 @@
+/********************************************************************
+* libavio/include/Latency.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace avio {
+
+// Keeps a live stream close to real time. The display reports the delay from packet arrival to
+// presentation of every frame, and once the smoothed delay has stayed above the target for a
+// while, update() asks for a recovery, which the video decoder carries out by skipping ahead to
+// a key frame. The skipped packets still go to the recording. A cooldown gives each recovery
+// time to drain through the pipeline.
+
+class Latency {
+public:
+    std::atomic<int> target_ms { 0 };   // zero only measures, no video is ever discarded
+    int hold_ms = 500;              // time above target before recovering, rides out short spikes
+    int cooldown_ms = 2000;
+    float smoothing = 0.1f;
+
+    std::atomic<float> current_ms { 0.0f };
+    std::atomic<int64_t> recoveries { 0 };
+    std::atomic<int64_t> discarded { 0 };
+    std::chrono::steady_clock::time_point behind_since;
+    std::chrono::steady_clock::time_point last_recovery;
+    bool behind = false;
+
+    std::function<void(float latency, int discarded, const std::string& uri)> latencyCallback = nullptr;
+
+    bool update(int64_t latency_us) {
+        // called from the display thread for each frame that could be matched to its packet
+        float ms = latency_us / 1000.0f;
+        float current = current_ms.load(std::memory_order_relaxed);
+        current = (current == 0.0f) ? ms : current + smoothing * (ms - current);
+        current_ms.store(current, std::memory_order_relaxed);
+
+        int target = target_ms.load(std::memory_order_relaxed);
+        if (target <= 0)
+            return false;
+
+        auto now = std::chrono::steady_clock::now();
+        if (current <= target) {
+            behind = false;
+            return false;
+        }
+        if (!behind) {
+            behind = true;
+            behind_since = now;
+        }
+        if (now - behind_since < std::chrono::milliseconds(hold_ms))
+            return false;
+        if (recoveries && now - last_recovery < std::chrono::milliseconds(cooldown_ms))
+            return false;
+        return true;
+    }
+
+    void recovered(int count, const std::string& uri) {
+        last_recovery = std::chrono::steady_clock::now();
+        behind = false;
+        if (count <= 0) return;
+        recoveries++;
+        discarded += count;
+        if (latencyCallback) latencyCallback(current_ms.load(), count, uri);
+    }
+
+    void reset() {
+        current_ms = 0.0f;
+        recoveries = 0;
+        discarded = 0;
+        behind = false;
+    }
+};
+
+}
+
+#endif // LATENCY_HPP
@@ -0,0 +1,255 @@
+/********************************************************************
+* libavio/include/Motion.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef MOTION_HPP
+#define MOTION_HPP
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AVIO_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define AVIO_NEON
+#endif
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#include "Frame.hpp"
+#include "Tap.hpp"
+
+namespace avio {
+
+class Motion : public Tap {
+public:
+    int scale = 4;
+    int threshold = 12;
+    int gain = 50;
+    std::atomic<float> level { 0.0f };
+
+    // buffers are held at the downscaled working resolution
+    int work_width = 0;
+    int work_height = 0;
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> previous;
+    std::vector<uint8_t> changed;
+    std::vector<uint8_t> roi;
+    std::vector<uint8_t> column;
+    std::vector<uint16_t> row_sum;
+    int64_t roi_count = 0;
+    bool first_pass = true;
+
+    std::mutex mutex;
+    std::vector<uint8_t> mask;
+    int mask_width = 0;
+    int mask_height = 0;
+    bool mask_changed = false;
+
+    std::function<void(float level, const std::string& uri)> motionCallback = nullptr;
+
+    Motion(const std::string& uri, int scale=4) : Tap("motion", uri) {
+        // row sums are 16 bit, which limits the downscale factor
+        this->scale = std::max(1, std::min(scale, 16));
+    }
+
+    void set_mask(const std::vector<uint8_t>& data, int w, int h) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (data.size() < (size_t)w * h) {
+            // an empty or malformed mask analyzes the whole frame
+            mask.clear();
+            mask_width = mask_height = 0;
+        }
+        else {
+            mask = data;
+            mask_width = w;
+            mask_height = h;
+        }
+        mask_changed = true;
+    }
+
+    void analyze(const Frame& f) override {
+        if (!has_luma_plane((AVPixelFormat)f.format()))
+            return;
+
+        downscale(f);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (mask_changed) {
+                update_roi();
+                mask_changed = false;
+            }
+        }
+
+        float result = 0.0f;
+        if (!first_pass) {
+            difference();
+            int64_t count = despeckle();
+            if (roi_count)
+                result = std::exp(0.2f * (gain - 50)) * 255.0f * (float)count / (float)roi_count;
+        }
+        std::swap(current, previous);
+        first_pass = false;
+
+        level = result;
+        if (motionCallback) motionCallback(result, uri);
+        emit(result, f.pts());
+    }
+
+    bool has_luma_plane(AVPixelFormat pix_fmt) const {
+        // any 8 bit planar or semi planar yuv format carries luma in the first plane
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+        if (!desc) return false;
+        if (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) return false;
+        return desc->comp[0].plane == 0 && desc->comp[0].step == 1 && desc->comp[0].depth == 8;
+    }
+
+    void resize(int w, int h) {
+        work_width = w;
+        work_height = h;
+        size_t n = (size_t)w * h;
+        current.assign(n, 0);
+        previous.assign(n, 0);
+        changed.assign(n, 0);
+        column.assign(w, 0);
+        row_sum.assign((size_t)w * scale, 0);
+        first_pass = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        update_roi();
+        mask_changed = false;
+    }
+
+    void downscale(const Frame& f) {
+        // box filter average of scale x scale blocks, which also takes out most of the sensor noise
+        int w = f.width() / scale;
+        int h = f.height() / scale;
+        if (w < 3 || h < 3)
+            throw std::runtime_error("frame is too small for the requested downscale");
+        if (w != work_width || h != work_height)
+            resize(w, h);
+
+        const uint8_t* src = f.frame->data[0];
+        int stride = f.frame->linesize[0];
+        int n = w * scale;
+        uint32_t area = scale * scale;
+        uint16_t* sum = row_sum.data();
+
+        for (int y = 0; y < h; y++) {
+            std::fill(row_sum.begin(), row_sum.end(), 0);
+            for (int k = 0; k < scale; k++) {
+                const uint8_t* line = src + (size_t)(y * scale + k) * stride;
+                for (int x = 0; x < n; x++)
+                    sum[x] += line[x];
+            }
+            uint8_t* dst = current.data() + (size_t)y * w;
+            for (int x = 0; x < w; x++) {
+                uint32_t total = 0;
+                const uint16_t* block = sum + x * scale;
+                for (int k = 0; k < scale; k++)
+                    total += block[k];
+                dst[x] = (uint8_t)(total / area);
+            }
+        }
+    }
+
+    void update_roi() {
+        // caller holds the mutex, the mask is resampled nearest neighbor to the working resolution
+        size_t n = (size_t)work_width * work_height;
+        roi.assign(n, 0xFF);
+        if (mask.size() && work_width && work_height) {
+            for (int y = 0; y < work_height; y++) {
+                const uint8_t* src = mask.data() + (size_t)(y * mask_height / work_height) * mask_width;
+                uint8_t* dst = roi.data() + (size_t)y * work_width;
+                for (int x = 0; x < work_width; x++)
+                    dst[x] = src[x * mask_width / work_width] ? 0xFF : 0x00;
+            }
+        }
+        // border pixels are never counted by the despeckle pass
+        roi_count = 0;
+        for (int y = 1; y < work_height - 1; y++)
+            for (int x = 1; x < work_width - 1; x++)
+                if (roi[(size_t)y * work_width + x]) roi_count++;
+    }
+
+    void difference() {
+        // changed = (|current - previous| > threshold) & roi, each pixel is either 0x00 or 0xFF
+        size_t n = current.size();
+        const uint8_t* a = current.data();
+        const uint8_t* b = previous.data();
+        const uint8_t* m = roi.data();
+        uint8_t* d = changed.data();
+        uint8_t t = (uint8_t)std::max(0, std::min(threshold, 255));
+        size_t i = 0;
+
+#if defined(AVIO_SSE2)
+        const __m128i thr = _mm_set1_epi8((char)t);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            __m128i quiet = _mm_cmpeq_epi8(_mm_subs_epu8(diff, thr), zero);
+            __m128i vm = _mm_loadu_si128((const __m128i*)(m + i));
+            _mm_storeu_si128((__m128i*)(d + i), _mm_andnot_si128(quiet, vm));
+        }
+#elif defined(AVIO_NEON)
+        const uint8x16_t thr = vdupq_n_u8(t);
+        for (; i + 16 <= n; i += 16) {
+            uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+            vst1q_u8(d + i, vandq_u8(vcgtq_u8(diff, thr), vld1q_u8(m + i)));
+        }
+#endif
+
+        for (; i < n; i++) {
+            int diff = std::abs((int)a[i] - (int)b[i]);
+            d[i] = (diff > t) ? m[i] : 0;
+        }
+    }
+
+    int64_t despeckle() {
+        // a pixel counts as motion when the majority of its 3x3 neighborhood changed,
+        // the same result as a 3x3 median on the binary image, isolated noise drops out
+        int64_t count = 0;
+        uint8_t* col = column.data();
+        for (int y = 1; y < work_height - 1; y++) {
+            const uint8_t* r0 = changed.data() + (size_t)(y - 1) * work_width;
+            const uint8_t* r1 = r0 + work_width;
+            const uint8_t* r2 = r1 + work_width;
+            const uint8_t* m = roi.data() + (size_t)y * work_width;
+            for (int x = 0; x < work_width; x++)
+                col[x] = (r0[x] & 1) + (r1[x] & 1) + (r2[x] & 1);
+            for (int x = 1; x < work_width - 1; x++)
+                count += ((col[x - 1] + col[x] + col[x + 1]) > 4) & (m[x] & 1);
+        }
+        return count;
+    }
+};
+
+}
+
+#endif // MOTION_HPP
@@ -0,0 +1,182 @@
+/********************************************************************
+* libavio/include/MotionVectors.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef MOTION_VECTORS_HPP
+#define MOTION_VECTORS_HPP
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/motion_vector.h>
+}
+
+#include "Frame.hpp"
+#include "Tap.hpp"
+
+namespace avio {
+
+class MotionVectors : public Tap {
+public:
+    int cell_size = 16;
+    float threshold = 1.0f;     // smoothed vector length in pixels for a cell to count as moving
+    float decay = 0.5f;
+    int gain = 50;
+    std::atomic<float> level { 0.0f };
+
+    int grid_width = 0;         // heatmap grid dimensions in cells
+    int grid_height = 0;
+    std::vector<float> heat;
+    std::vector<float> sum;
+    std::vector<uint16_t> hits;
+    std::vector<uint8_t> roi;
+    int64_t roi_count = 0;
+
+    std::mutex mutex;
+    std::vector<uint8_t> mask;
+    int mask_width = 0;
+    int mask_height = 0;
+    bool mask_changed = false;
+
+    std::function<void(float level, const std::string& uri)> motionCallback = nullptr;
+
+    MotionVectors(const std::string& uri) : Tap("motion_vectors", uri) { }
+
+    static bool supported(AVCodecID codec_id) {
+        // codecs whose ffmpeg decoders honor AV_CODEC_EXPORT_DATA_MVS, hevc is not one of them
+        switch (codec_id) {
+            case AV_CODEC_ID_H264:
+            case AV_CODEC_ID_MPEG4:
+            case AV_CODEC_ID_MPEG1VIDEO:
+            case AV_CODEC_ID_MPEG2VIDEO:
+            case AV_CODEC_ID_H263:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void set_mask(const std::vector<uint8_t>& data, int w, int h) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (data.size() < (size_t)w * h) {
+            mask.clear();
+            mask_width = mask_height = 0;
+        }
+        else {
+            mask = data;
+            mask_width = w;
+            mask_height = h;
+        }
+        mask_changed = true;
+    }
+
+    std::vector<float> heatmap() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return heat;
+    }
+
+    void analyze(const Frame& f) override {
+        // intra coded frames carry no vectors, the last level stands until the next predicted frame
+        AVFrameSideData* sd = av_frame_get_side_data(f.frame, AV_FRAME_DATA_MOTION_VECTORS);
+        if (!sd)
+            return;
+
+        int w = (f.width() + cell_size - 1) / cell_size;
+        int h = (f.height() + cell_size - 1) / cell_size;
+        if (w != grid_width || h != grid_height)
+            resize(w, h);
+
+        std::fill(sum.begin(), sum.end(), 0.0f);
+        std::fill(hits.begin(), hits.end(), 0);
+
+        const AVMotionVector* mvs = (const AVMotionVector*)sd->data;
+        size_t count = sd->size / sizeof(AVMotionVector);
+        for (size_t i = 0; i < count; i++) {
+            const AVMotionVector& mv = mvs[i];
+            if (!mv.motion_scale) continue;
+            int x = mv.dst_x / cell_size;
+            int y = mv.dst_y / cell_size;
+            if (x < 0 || y < 0 || x >= grid_width || y >= grid_height) continue;
+            float dx = (float)mv.motion_x / mv.motion_scale;
+            float dy = (float)mv.motion_y / mv.motion_scale;
+            // backward predicted vectors of b frames span a different interval, so only the magnitude is used
+            size_t idx = (size_t)y * grid_width + x;
+            sum[idx] += std::sqrt(dx * dx + dy * dy) * (mv.w * mv.h) / (float)(cell_size * cell_size);
+            hits[idx]++;
+        }
+
+        int64_t active = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (mask_changed) {
+                update_roi();
+                mask_changed = false;
+            }
+            for (size_t i = 0; i < heat.size(); i++) {
+                float magnitude = hits[i] ? sum[i] : 0.0f;
+                heat[i] = decay * heat[i] + (1.0f - decay) * magnitude;
+                if (roi[i] && heat[i] > threshold)
+                    active++;
+            }
+        }
+
+        float result = 0.0f;
+        if (roi_count)
+            result = std::exp(0.2f * (gain - 50)) * 255.0f * (float)active / (float)roi_count;
+
+        level = result;
+        if (motionCallback) motionCallback(result, uri);
+        emit(result, f.pts());
+    }
+
+    void resize(int w, int h) {
+        std::lock_guard<std::mutex> lock(mutex);
+        grid_width = w;
+        grid_height = h;
+        size_t n = (size_t)w * h;
+        heat.assign(n, 0.0f);
+        sum.assign(n, 0.0f);
+        hits.assign(n, 0);
+        update_roi();
+        mask_changed = false;
+    }
+
+    void update_roi() {
+        // caller holds the mutex
+        size_t n = (size_t)grid_width * grid_height;
+        roi.assign(n, 1);
+        if (mask.size() && grid_width && grid_height) {
+            for (int y = 0; y < grid_height; y++)
+                for (int x = 0; x < grid_width; x++)
+                    roi[(size_t)y * grid_width + x] = mask[(size_t)(y * mask_height / grid_height) * mask_width + x * mask_width / grid_width] ? 1 : 0;
+        }
+        roi_count = 0;
+        for (uint8_t r : roi)
+            roi_count += r;
+    }
+};
+
+}
+
+#endif // MOTION_VECTORS_HPP
@@ -24,6 +24,7 @@
 
 #include <thread>
 #include <map>
+#include <algorithm>
 
 #include "Packet.hpp"
 #include "Frame.hpp"
@@ -35,6 +36,16 @@
 #include "Decoder.hpp"
 #include "Drain.hpp"
 #include "Writer.hpp"
+#include "Motion.hpp"
+#include "MotionVectors.hpp"
+#include "Tap.hpp"
+#include "Stats.hpp"
+#include "Latency.hpp"
+#include "Startup.hpp"
+#include "Hub.hpp"
+#include "FrameBus.hpp"
+#include "Snapshot.hpp"
+#include "Trace.hpp"
 
 namespace avio {
 
@@ -47,6 +58,9 @@ public:
     std::string str_hw_device_type;
     std::string str_video_filter;
     std::string str_audio_filter;
+    std::string input_format;
+    bool realtime = false;
+    bool loop = false;
     std::map<std::string, std::string> metadata;
     int log_level = AV_LOG_QUIET; //AV_LOG_DEBUG
     bool crashed = false;
@@ -59,6 +73,9 @@ public:
     std::function<void(const std::string& uri)> packetDrop = nullptr;
     std::function<void(const std::string& msg, const std::string& uri)> infoCallback = nullptr;
     std::function<void(const std::string& msg, const std::string& uri, bool reconnect)> errorCallback = nullptr;
+    std::function<void(float level, const std::string& uri)> motionCallback = nullptr;
+    std::function<void(const TapEvent& event)> eventCallback = nullptr;
+    std::function<void(float latency, int discarded, const std::string& uri)> latencyCallback = nullptr;
 
     bool request_reconnect = true;
     int buffer_size_in_seconds = 1;
@@ -70,18 +87,62 @@ public:
     float volume = 1.0;
     bool mute = false;
     AVRational onvif_frame_rate;
+    bool visible = true;            // the stream is on screen, false for tiles scrolled away or covered
+    bool analyze_video = false;     // decoded frames are used outside of libavio even when not visible
+    bool analyze_audio = false;     // decoded audio is used outside of libavio even when muted
+    bool lazy_decode = true;        // live stream decoders idle while nothing uses their output
+
+    bool motion_detect = false;
+    int motion_scale = 4;
+    int motion_threshold = 12;
+    int motion_gain = 50;
+    std::vector<uint8_t> motion_mask;
+    int motion_mask_width = 0;
+    int motion_mask_height = 0;
+    bool motion_vectors = false;
+    float vector_threshold = 1.0f;
+    bool activity_detect = false;
+    int latency_target = 0;         // milliseconds from packet arrival to display, zero turns recovery off
+    int open_timeout = 5000;        // milliseconds allowed to connect
+    int read_timeout = 5000;        // milliseconds without a packet before a live stream is closed
+    int probe_timeout = 5000;       // milliseconds allowed to probe the streams
+    bool fast_reconnect = true;     // live streams reopen with the parameters of the previous session
+    StreamHint stream_hint;         // expected codecs and dimensions, shortens the probe when set
+    bool shared_ingest = false;     // live streams subscribe to one hub per uri instead of opening their own session
+    int admission_priority = 0;     // higher is shed later and restored sooner
+    int admission_handle = 0;
+    int startup_priority = 0;       // higher opens first
+    int startup_handle = 0;
 
     Reader* reader         = nullptr;
     Decoder* video_decoder = nullptr;
     Decoder* audio_decoder = nullptr;
     Filter* video_filter   = nullptr;
     Filter* audio_filter   = nullptr;
-    Display* display       = nullptr;
+    Display* display       = nullptr;     // deleted from the play thread while other threads take its frames
     Audio* audio           = nullptr;
     Writer* writer         = nullptr;
+    Motion* motion         = nullptr;
+    MotionVectors* vectors = nullptr;
+    Activity* activity     = nullptr;
+    Scheduler* scheduler   = nullptr;
+    Admission* admission   = nullptr;
+    Startup* startup       = nullptr;
+    std::shared_ptr<Hub> hub;
+    std::shared_ptr<HubSubscriber> subscription;
+    std::shared_ptr<FrameBus> frame_bus;
+    std::vector<Tap*> taps;
+    Stats stats;
+    Latency latency;
+    mutable std::mutex display_mutex;
+    mutable std::mutex detector_mutex;   // motion, vectors and activity are deleted from the play thread while getters read them
+    std::mutex reader_mutex;        // orders terminate against the open of the reader
+    bool cancelled = false;         // terminated before the reader was set, guarded by reader_mutex
 
     Player(const std::string& uri) : uri(uri) { av_log_set_level(log_level); }
-    ~Player() { }
+    ~Player() {
+        if (startup && startup_handle) startup->remove(startup_handle);
+    }
 
     static void clear_callback(void* player) {
         ((Player*)player)->clear_queues();
@@ -99,7 +160,7 @@ public:
                 audio_decoder->pkts->push(Packet(flush));
             }
             if (video_decoder) {
-                video_decoder->frames->clear();
+                if (video_decoder->frames) video_decoder->frames->clear();
                 AVPacket* flush = av_packet_alloc();
                 flush->data = (uint8_t*)"FLUSH";
                 video_decoder->pkts->push(Packet(flush));
@@ -117,6 +178,9 @@ public:
         std::thread* audio_filter_thread  = nullptr;
         std::thread* display_thread       = nullptr;
         std::thread* writer_thread        = nullptr;
+        std::thread* activity_thread      = nullptr;
+        std::vector<std::thread*> tap_threads;
+        std::vector<Tap*> active_taps;
 
         Queue<Packet> video_pkts(128);
         Queue<Packet> audio_pkts(128);
@@ -127,7 +191,49 @@ public:
         Queue<Packet> writer_pkts(128);
 
         try {
-            reader = new Reader(uri);
+            stats.reset();
+            latency.reset();
+            latency.target_ms = latency_target;
+            latency.latencyCallback = latencyCallback;
+            ReaderOptions options;
+            options.open_timeout_ms = open_timeout;
+            options.read_timeout_ms = read_timeout;
+            options.probe_timeout_ms = probe_timeout;
+            options.reuse_parameters = fast_reconnect && live_stream;
+            options.hint = stream_hint;
+            options.realtime = realtime;
+            options.loop = loop;
+            Reader* opened = open_reader(options);
+            {
+                std::lock_guard<std::mutex> lock(reader_mutex);
+                if (opened && cancelled) {
+                    // terminated while the stream was opening
+                    delete opened;
+                    opened = nullptr;
+                }
+                reader = opened;
+            }
+            if (!reader) {
+                // cancelled while waiting for its turn to open, or while opening
+                if (startup) startup->release(startup_handle);
+                if (hub) {
+                    hub->detach(subscription);
+                    subscription.reset();
+                    hub.reset();
+                }
+                rearm();
+                if (mediaPlayingStopped) {
+                    std::thread thread([&]() { mediaPlayingStopped(uri); });
+                    thread.detach();
+                }
+                return;
+            }
+            stats.open_us = reader->open_us;
+            stats.probe_us = reader->probe_us;
+            stats.probe_fallback = reader->probe_fallback;
+            if (reader->probe_fallback && infoCallback)
+                infoCallback("stream did not match the hint, probed in full", uri);
+            reader->stats = &stats;
             reader->clear_callback = clear_callback;
             reader->player = this;
             reader->live_stream = live_stream;
@@ -137,7 +243,19 @@ public:
             reader->disable_audio = disable_audio;
             reader->disable_video = disable_video;
 
-            if (!disable_video && !hidden)
+            if (activity_detect && reader->has_video()) {
+                std::lock_guard<std::mutex> lock(detector_mutex);
+                activity = new Activity(uri);
+                activity->gain = motion_gain;
+                activity->motionCallback = motionCallback;
+                reader->activity = activity;
+            }
+
+            // hidden streams being analyzed are decoded, but never filtered or displayed
+            bool video_taps = std::any_of(taps.begin(), taps.end(), [](Tap* tap) { return tap->media_type == AVMEDIA_TYPE_VIDEO; });
+            bool analyze_hidden = hidden && (motion_detect || motion_vectors || video_taps);
+
+            if (!disable_video && (!hidden || analyze_hidden))
                 reader->video_pkts = &video_pkts;
             if (!disable_audio && !hidden)
                 reader->audio_pkts = &audio_pkts;
@@ -147,6 +265,7 @@ public:
                 writer->disable_audio = disable_audio;
                 writer->disable_video = disable_video;
                 writer->input = &writer_pkts;
+                writer->stats = &stats.writer;
                 if (hidden) {
                     reader->writer_pkts = &writer_pkts;
                 }
@@ -155,44 +274,113 @@ public:
             if (file_start_from_seek > 0.0)
                 seek(file_start_from_seek);
 
-            if (reader->has_video() && !disable_video && !hidden) {
+            if (reader->has_video() && !disable_video && (!hidden || analyze_hidden)) {
+                bool export_mvs = motion_vectors && MotionVectors::supported(reader->video_codec());
+                if (motion_vectors && !export_mvs && infoCallback)
+                    infoCallback("motion vectors are not available for " + reader->str_video_codec() + " streams", uri);
                 AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
                 if (!str_hw_device_type.empty()) {
                     type = av_hwdevice_find_type_by_name(str_hw_device_type.c_str());
+                    if (type != AV_HWDEVICE_TYPE_NONE && export_mvs) {
+                        // hardware decoders do not export motion vectors
+                        type = AV_HWDEVICE_TYPE_NONE;
+                        if (infoCallback) infoCallback("motion vectors need software decoding, the hardware decoder is not used", uri);
+                    }
                     if (type != AV_HWDEVICE_TYPE_NONE)
                         std::cout << "using hw decoder " << str_hw_device_type << std::endl;
                 }
-                video_decoder = new Decoder(reader, AVMEDIA_TYPE_VIDEO, &video_pkts, &decoded_video_frames, type);
-                if (live_stream)
-                    video_decoder->writer_pkts = &writer_pkts;
-                video_filter = new Filter(video_decoder, str_video_filter, &decoded_video_frames, &filtered_video_frames);
+                video_decoder = new Decoder(reader, AVMEDIA_TYPE_VIDEO, &video_pkts, hidden ? nullptr : &decoded_video_frames, type, export_mvs);
+                video_decoder->stats = &stats.video_decoder;
+                video_decoder->demand = [&] { return videoDemand(); };
+                if (admission) {
+                    admission_handle = admission->add(uri, admission_priority);
+                    video_decoder->admission = admission;
+                    video_decoder->slot = admission->get(admission_handle);
+                }
+                if (hidden) {
+                    // nobody sees these frames, deblocking is wasted effort for analysis
+                    video_decoder->codec_ctx->skip_loop_filter = AVDISCARD_ALL;
+                }
+                else {
+                    if (live_stream)
+                        video_decoder->writer_pkts = &writer_pkts;
+                    video_filter = new Filter(video_decoder, str_video_filter, &decoded_video_frames, &filtered_video_frames);
+                    video_filter->stats = &stats.video_filter;
+                }
+                if (export_mvs) {
+                    std::lock_guard<std::mutex> lock(detector_mutex);
+                    vectors = new MotionVectors(uri);
+                    vectors->threshold = vector_threshold;
+                    vectors->gain = motion_gain;
+                    vectors->set_mask(motion_mask, motion_mask_width, motion_mask_height);
+                    vectors->motionCallback = motionCallback;
+                    vectors->eventCallback = eventCallback;
+                    active_taps.push_back(vectors);
+                }
+                if (motion_detect) {
+                    std::lock_guard<std::mutex> lock(detector_mutex);
+                    motion = new Motion(uri, motion_scale);
+                    motion->threshold = motion_threshold;
+                    motion->gain = motion_gain;
+                    motion->set_mask(motion_mask, motion_mask_width, motion_mask_height);
+                    motion->motionCallback = motionCallback;
+                    motion->eventCallback = eventCallback;
+                    active_taps.push_back(motion);
+                }
             }
             if (reader->has_audio() && !disable_audio && !hidden) {
                 audio_decoder = new Decoder(reader, AVMEDIA_TYPE_AUDIO, &audio_pkts, &decoded_audio_frames);
+                audio_decoder->stats = &stats.audio_decoder;
+                audio_decoder->demand = [&] { return audioDemand(); };
                 if (live_stream)
                     audio_decoder->writer_pkts = &writer_pkts;
                 audio_filter = new Filter(audio_decoder, str_audio_filter, &decoded_audio_frames, &filtered_audio_frames);
+                audio_filter->stats = &stats.audio_filter;
             }
             
-            reader_thread = new std::thread([&] { while (reader->read()) {} });
+            for (Tap* tap : taps) {
+                // filtered taps on hidden streams fall back to the decoder output
+                Decoder* decoder = (tap->media_type == AVMEDIA_TYPE_VIDEO) ? video_decoder : audio_decoder;
+                if (!decoder) continue;
+                tap->uri = uri;
+                if (!tap->eventCallback) tap->eventCallback = eventCallback;
+                active_taps.push_back(tap);
+            }
+            for (Tap* tap : active_taps) {
+                Decoder* decoder = (tap->media_type == AVMEDIA_TYPE_VIDEO) ? video_decoder : audio_decoder;
+                Filter* filter = (tap->media_type == AVMEDIA_TYPE_VIDEO) ? video_filter : audio_filter;
+                if (tap->filtered && filter)
+                    filter->taps.push_back(tap);
+                else
+                    decoder->taps.push_back(tap);
+                tap->open();
+            }
+
+            reader_thread = new std::thread([&] { Trace::set_thread_name("reader " + uri); while (reader->read()) {} });
+            if (activity)
+                activity_thread = new std::thread([&] { while (activity->estimate()) {} });
             
             if (video_decoder) {
-                video_decoder_thread = new std::thread([&] { while (video_decoder->decode()) {} });
-                video_filter_thread = new std::thread([&] { while (video_filter->filter()) {} });
+                video_decoder_thread = new std::thread([&] { Trace::set_thread_name("video decoder " + uri); while (video_decoder->decode()) {} });
+                if (video_filter)
+                    video_filter_thread = new std::thread([&] { Trace::set_thread_name("video filter " + uri); while (video_filter->filter()) {} });
             }
             if (audio_decoder) {
-                audio_decoder_thread = new std::thread([&] { while (audio_decoder->decode()) {} });
-                audio_filter_thread = new std::thread([&] { while (audio_filter->filter()) {} });
+                audio_decoder_thread = new std::thread([&] { Trace::set_thread_name("audio decoder " + uri); while (audio_decoder->decode()) {} });
+                audio_filter_thread = new std::thread([&] { Trace::set_thread_name("audio filter " + uri); while (audio_filter->filter()) {} });
             }
             if (writer) {
-                writer_thread = new std::thread([&] { while (writer->write()) {} });
+                writer_thread = new std::thread([&] { Trace::set_thread_name("writer " + uri); while (writer->write()) {} });
             }
+            for (Tap* tap : active_taps)
+                tap_threads.push_back(new std::thread([tap] { Trace::set_thread_name(tap->name + " " + tap->uri); while (tap->run()) {} }));
 
             if (reader->has_audio() && !disable_audio && !hidden) {
                 audio = new Audio(reader, &filtered_audio_frames, audio_driver_index);
                 audio->volume = volume;
                 audio->mute = mute;
                 audio->pyAudioCallback = pyAudioCallback;
+                audio->stats = &stats.audio;
                 if (!reader->has_video())
                     audio->progressCallback = progressCallback;
             }
@@ -201,12 +389,21 @@ public:
                 mediaPlayingStarted(uri);
             }
 
+            if (startup) startup->ready(startup_handle);
+
             if (reader->has_video() && !disable_video && !hidden) {
-                display = new Display(reader, &filtered_video_frames, headless);
+                {
+                    std::lock_guard<std::mutex> lock(display_mutex);
+                    display = new Display(reader, &filtered_video_frames, headless);
+                }
                 display->renderCallback = renderCallback;
                 display->progressCallback = progressCallback;
+                display->scheduler = scheduler;
+                display->stats = &stats;
+                display->latency = &latency;
+                display->decoder = video_decoder;
                 if (headless)
-                    display_thread = new std::thread([&] { while (display->render()) {} });
+                    display_thread = new std::thread([&] { Trace::set_thread_name("display " + uri); while (display->render()) {} });
                 else 
                     while (display->render()) {}
             }
@@ -224,24 +421,44 @@ public:
                 if (reader) reader->terminate();
             }
         }
+        if (startup) startup->release(startup_handle);
 
         if (display_thread)       display_thread->join();
+        for (std::thread* thread : tap_threads) thread->join();
         if (audio_filter_thread)  audio_filter_thread->join();
         if (audio_decoder_thread) audio_decoder_thread->join();
         if (video_filter_thread)  video_filter_thread->join();
         if (video_decoder_thread) video_decoder_thread->join();
         if (reader_thread)        reader_thread->join();
+        if (activity)             activity->close();
+        if (activity_thread)      activity_thread->join();
         if (writer_thread)        writer_thread->join();
+        if (admission && admission_handle) {
+            admission->remove(admission_handle);
+            admission_handle = 0;
+        }
 
         if (display_thread)       { delete display_thread;       display_thread       = nullptr; }
+        for (std::thread* thread : tap_threads) delete thread;
         if (audio_filter_thread)  { delete audio_filter_thread;  audio_filter_thread  = nullptr; }
         if (audio_decoder_thread) { delete audio_decoder_thread; audio_decoder_thread = nullptr; }
         if (video_filter_thread)  { delete video_filter_thread;  video_filter_thread  = nullptr; }
         if (video_decoder_thread) { delete video_decoder_thread; video_filter_thread  = nullptr; }
         if (writer_thread)        { delete writer_thread;        writer_thread        = nullptr; }
         if (reader_thread)        { delete reader_thread;        reader_thread        = nullptr; }
+        if (activity_thread)      { delete activity_thread;      activity_thread      = nullptr; }
 
-        if (display)              { delete display;              display              = nullptr; }
+        if (display) {
+            std::lock_guard<std::mutex> lock(display_mutex);
+            delete display;
+            display = nullptr;
+        }
+        {
+            std::lock_guard<std::mutex> lock(detector_mutex);
+            if (motion)           { delete motion;               motion               = nullptr; }
+            if (vectors)          { delete vectors;              vectors              = nullptr; }
+            if (activity)         { delete activity;             activity             = nullptr; }
+        }
         if (writer)               { delete writer;               writer               = nullptr; }
         if (video_filter)         { delete video_filter;         video_filter         = nullptr; }
         if (video_decoder)        { delete video_decoder;        video_decoder        = nullptr; }
@@ -264,7 +481,17 @@ public:
             audio = nullptr;
         }
         //////////////////////////////////////////
-        if (reader)               { delete reader;               reader               = nullptr; }
+        if (reader) {
+            std::lock_guard<std::mutex> lock(reader_mutex);
+            delete reader;
+            reader = nullptr;
+        }
+        if (hub) {
+            hub->detach(subscription);
+            subscription.reset();
+            hub.reset();
+        }
+        rearm();
 
         if (mediaPlayingStopped) {
             std::thread thread([&]() { 
@@ -274,20 +501,77 @@ public:
         }
     }
 
+    Reader* create_reader(const ReaderOptions& options) {
+        if (!shared_ingest || !live_stream)
+            return new Reader(uri, input_format, options);
+        // the subscription starts at the next key frame of a stream that may already be running
+        hub = Hub::open(uri, input_format, options);
+        subscription = hub->attach(hidden ? "analysis " + std::to_string((intptr_t)this) : "player " + std::to_string((intptr_t)this));
+        Reader* result = new Reader(uri, hub->context(), &subscription->pkts);
+        result->open_us = hub->reader->open_us;
+        result->probe_us = hub->reader->probe_us;
+        return result;
+    }
+
+    Reader* open_reader(const ReaderOptions& options) {
+        // with a startup orchestrator the open waits its turn, and failed attempts are retried after a backoff
+        {
+            std::lock_guard<std::mutex> lock(reader_mutex);
+            if (cancelled)
+                return nullptr;
+            if (startup && !startup_handle)
+                startup_handle = startup->add(uri, startup_priority);
+        }
+        if (!startup)
+            return create_reader(options);
+        for (bool retry = false; ; retry = true) {
+            if (!startup->acquire(startup_handle, retry))
+                return nullptr;
+            try {
+                Reader* result = create_reader(options);
+                startup->opened(startup_handle, result->open_us, result->probe_us);
+                return result;
+            }
+            catch (const std::exception& e) {
+                if (!startup->failed(startup_handle, e.what())) {
+                    std::lock_guard<std::mutex> lock(reader_mutex);
+                    if (cancelled)
+                        return nullptr;
+                    throw;
+                }
+                if (infoCallback) infoCallback(std::string("open failed, retrying: ") + e.what(), uri);
+            }
+        }
+    }
+
+    void rearm() {
+        // a new run is not cancelled by a terminate of the previous one, and queues for startup afresh
+        std::lock_guard<std::mutex> lock(reader_mutex);
+        cancelled = false;
+        if (startup && startup_handle) startup->remove(startup_handle);
+        startup_handle = 0;
+    }
+
     void start() {
+        rearm();
         std::thread thread([&]() { play(); });
         thread.detach();
     }
 
     void terminate() {
-        if (!reader)
+        // a terminate before the reader is set is kept, so the stream is closed as soon as it opens
+        std::lock_guard<std::mutex> lock(reader_mutex);
+        if (!reader) {
+            cancelled = true;
+            if (startup && startup_handle) startup->cancel(startup_handle);
             return;
+        }
         std::thread thread([&]() { reader->terminate(); });
         thread.detach();
     }
 
     void seek(float pct) {
-        if (!reader) return;
+        if (!reader || reader->source) return;
         if (reader->closed) return;
         AVRational time_base = reader->video_time_base();
         if (!reader->has_video())
@@ -295,6 +579,7 @@ public:
         reader->seek_pts = (reader->start_time() + (pct * reader->duration()) / av_q2d(time_base)) / 1000;
         if (reader->paused) {
             reader->clear_callback(reader->player);
+            std::lock_guard<std::mutex> lock(display_mutex);
             if (display) {
                 display->one_shot = true;
             }
@@ -308,14 +593,24 @@ public:
     int         height()           const { return reader ? reader->height() : -1; }
     bool        isPaused()         const { return reader ? reader->paused : false; }
     bool        isRecording()      const { return reader ? reader->recording : false; }
+    bool        isCapturing()      const { return reader ? reader->capture != nullptr : false; }
     bool        isMuted()          const { return audio ? audio->mute : false; }
     bool        hasVideo()         const { return reader ? reader->has_video() : false; }
     bool        hasAudio()         const { return reader ? reader->has_audio() : false; }
     int64_t     duration()         const { return reader ? reader->duration() : 0; }
     int         getVolume()        const { return audio ? (int)(100 * audio->volume) : 0; }
     std::string getAudioCodec()    const { return reader ? reader->str_audio_codec() : "unknown"; }
+    float       getLatency()       const { return latency.current_ms.load(); }
+    float       getTimeToFirstFrame() const { return stats.first_frame_us.load() < 0 ? -1.0f : stats.first_frame_us.load() / 1000.0f; }
+    int         getStartupPosition() const { return startup && startup_handle ? startup->position(startup_handle) : -1; }
+    int         getShedLevel()     const { return video_decoder ? video_decoder->shed_level : 0; }
 
 
+    std::map<std::string, std::map<std::string, double>> getStats() const {
+        // counters since the stream was last opened, cheap enough to poll every second
+        return stats.snapshot();
+    }
+
     std::string getStreamInfo() const {
         return reader ? reader->get_stream_info() : "no stream info available";
     }
@@ -380,6 +675,157 @@ public:
         if (audio) audio->mute = arg; 
     }
 
+    void setMotionGain(int arg) {
+        motion_gain = arg;
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        if (motion) motion->gain = arg;
+        if (vectors) vectors->gain = arg;
+        if (activity) activity->gain = arg;
+    }
+
+    float getMotionLevel() const {
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        return motion ? motion->level.load() : (vectors ? vectors->level.load() : 0.0f);
+    }
+
+    float getActivityLevel() const {
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        return activity ? activity->level.load() : 0.0f;
+    }
+
+    std::vector<float> getMotionHeatmap() {
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        return vectors ? vectors->heatmap() : std::vector<float>();
+    }
+
+    std::vector<int> getMotionHeatmapSize() const {
+        // columns and rows of the heatmap grid, one cell per macroblock
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        return vectors ? std::vector<int>{ vectors->grid_width, vectors->grid_height } : std::vector<int>{ 0, 0 };
+    }
+
+    void addTap(Tap* tap) {
+        // taps are owned by the caller and attach to the stream the next time play starts
+        if (tap) taps.push_back(tap);
+    }
+
+    bool videoDemand() const {
+        // hidden streams only decode video for their analytics, so they always have a consumer
+        if (!lazy_decode || !live_stream || visible || analyze_video || hidden || scheduler)
+            return true;
+        return (video_decoder && video_decoder->taps.size()) || (video_filter && video_filter->taps.size());
+    }
+
+    bool audioDemand() const {
+        if (!lazy_decode || !live_stream || !mute || analyze_audio)
+            return true;
+        return (audio_decoder && audio_decoder->taps.size()) || (audio_filter && audio_filter->taps.size());
+    }
+
+    bool isDecodingVideo() const { return video_decoder && !video_decoder->idle; }
+    bool isDecodingAudio() const { return audio_decoder && !audio_decoder->idle; }
+
+    void publishFrames(const std::string& name, const std::string& pix_fmt="", int width=0, int height=0, int slots=4) {
+        // decoded frames go to shared memory under the name from the next time play starts, for
+        // FrameBusReader in other processes, the bus is kept until the player is destroyed
+        if (frame_bus) return;
+        frame_bus = std::make_shared<FrameBus>(name, slots);
+        if (pix_fmt.length()) frame_bus->pix_fmt = av_get_pix_fmt(pix_fmt.c_str());
+        frame_bus->width = width;
+        frame_bus->height = height;
+        taps.push_back(frame_bus.get());
+    }
+
+    Frame getLatestFrame() const {
+        // called from other threads, the display is deleted under the lock when play ends
+        std::lock_guard<std::mutex> lock(display_mutex);
+        return display ? display->latest() : Frame(nullptr);
+    }
+
+    std::vector<uint8_t> captureSnapshot(const std::string& path="", int quality=90, int max_size=0, const std::vector<Detection>& boxes=std::vector<Detection>()) {
+        // jpeg of the latest frame, written to the path by the encoder thread without waiting,
+        // or returned to the caller when no path is given
+        Frame f = getLatestFrame();
+        if (f.is_null())
+            throw std::runtime_error("no frame is available for a snapshot of " + uri);
+        std::unique_ptr<SnapshotJob> job(new SnapshotJob());
+        job->frame = f;
+        job->path = path;
+        job->quality = quality;
+        job->max_size = max_size;
+        job->boxes = boxes;
+        if (path.length() && infoCallback) {
+            std::function<void(const std::string&, const std::string&)> callback = infoCallback;
+            std::string name = uri;
+            job->errorCallback = [callback, name](const std::string& error) { callback("snapshot error: " + error, name); };
+        }
+        std::future<std::vector<uint8_t>> result = SnapshotEncoder::shared().submit(std::move(job));
+        if (path.empty())
+            return result.get();
+        return std::vector<uint8_t>();
+    }
+
+    std::string getFrameBusName() const { return frame_bus ? frame_bus->bus_name : ""; }
+
+    void setScheduler(Scheduler* arg) {
+        // frames are offered to the scheduler as they are displayed, shared by all players
+        scheduler = arg;
+        std::lock_guard<std::mutex> lock(display_mutex);
+        if (display) display->scheduler = arg;
+    }
+
+    void setStartup(Startup* arg) {
+        // shared by all players, limits how many of them are opening their streams at once
+        std::lock_guard<std::mutex> lock(reader_mutex);
+        if (startup && startup_handle) startup->remove(startup_handle);
+        startup_handle = 0;
+        startup = arg;
+    }
+
+    void setStartupPriority(int arg) {
+        // visible or focused tiles should have a higher priority so that they open first
+        startup_priority = arg;
+        if (startup && startup_handle) startup->set_priority(startup_handle, arg);
+    }
+
+    std::map<std::string, double> getStartupTimings() const {
+        std::map<std::string, double> result = startup && startup_handle ? startup->timings(startup_handle) : std::map<std::string, double>();
+        for (const auto& [key, value] : stats.snapshot()["startup"])
+            if (!result.count(key)) result[key] = value;
+        return result;
+    }
+
+    void setAdmission(Admission* arg) {
+        // shared by all players, takes effect the next time play starts
+        admission = arg;
+    }
+
+    void setAdmissionPriority(int arg) {
+        admission_priority = arg;
+        if (admission && admission_handle) admission->set_priority(admission_handle, arg);
+    }
+
+    void setLatencyTarget(int arg) {
+        latency_target = arg;
+        latency.target_ms = arg;
+    }
+
+    void setMotionThreshold(int arg) {
+        motion_threshold = arg;
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        if (motion) motion->threshold = arg;
+    }
+
+    void setMotionMask(const std::vector<uint8_t>& mask, int width, int height) {
+        // the mask may be any resolution, non zero values mark the region to be analyzed
+        motion_mask = mask;
+        motion_mask_width = width;
+        motion_mask_height = height;
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        if (motion) motion->set_mask(mask, width, height);
+        if (vectors) vectors->set_mask(mask, width, height);
+    }
+
     void clearBuffer() {
         if (reader) {
             if (reader->video_pkts) reader->video_pkts->clear();
@@ -392,6 +838,15 @@ public:
         if (reader) reader->recording = !reader->recording;
     }
 
+    void startCapture(const std::string& filename) {
+        // dumps the demuxed packets with their arrival times, the file plays back as a uri ending in .avcap
+        if (reader) reader->start_capture(filename);
+    }
+
+    void stopCapture() {
+        if (reader) reader->stop_capture();
+    }
+
     void startFileBreak(const std::string& filename) {
         if (writer) writer->filename = filename;
         std::thread thread([&]() { file_break(); });
@@ -25,6 +25,8 @@
 #include <condition_variable>
 #include <exception>
 
+#include "Packet.hpp"
+
 namespace avio {
 
 template <typename T>
@@ -50,6 +52,17 @@ public:
         cv_empty.notify_one();
     }
 
+    // non-blocking push for consumers that would rather lose an element than stall the producer
+    bool try_push(T&& element) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (queue.size() >= max_size)
+            return false;
+        queue.push_back(std::move(element));
+        lock.unlock();
+        cv_empty.notify_one();
+        return true;
+    }
+
     T pop() {
         std::unique_lock<std::mutex> lock(mutex);
         cv_empty.wait(lock, [&] { return !queue.empty(); });
@@ -135,6 +148,23 @@ public:
         return SIZE_MAX; 
     }
 
+    // the number of elements ahead of the newest key frame, the return is negative when the only
+    // key frame, if any, is already at the front, then it is the whole queue and the caller has to
+    // wait for the next key frame, a queue of less than two gives zero
+    int count_to_last_key_frame() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if constexpr(std::is_same_v<T, Packet>) {
+            if (queue.size() < 2)
+                return 0;
+            for (int i = queue.size() - 1; i > 0; i--) {
+                if (queue[i].is_key_frame())
+                    return i;
+            }
+            return -(int)queue.size();
+        }
+        return 0;
+    }
+
     size_t find_first_key_frame(size_t starting_index) {
         std::lock_guard<std::mutex> lock(mutex);
         if constexpr(std::is_same_v<T, Packet>) {
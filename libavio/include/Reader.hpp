@@ -22,26 +22,46 @@
 
 #include <iostream>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <vector>
+#include <memory>
+#include <algorithm>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
+#include <libavdevice/avdevice.h>
 }
 
 #include "Packet.hpp"
 #include "Queue.hpp"
 #include "Filter.hpp"
 #include "Exception.hpp"
+#include "Activity.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include "Capture.hpp"
 
 struct CallbackParams {
-    time_t timeout_start = time(nullptr);
+    int64_t timeout_start = avio::steady_us();
+    int64_t timeout_us = 5000000;
     bool triggered = false;
+    std::atomic<bool> aborted { false };
+
+    void arm(int timeout_ms) {
+        timeout_us = (int64_t)timeout_ms * 1000;
+        timeout_start = avio::steady_us();
+    }
 };
 
-#define MAX_TIMEOUT 5
 static int interrupt_callback(void *ctx) {
     CallbackParams* callback_params = (CallbackParams*)ctx;
-    time_t diff = time(nullptr) - callback_params->timeout_start;
-    if (diff > MAX_TIMEOUT) {
+    int64_t diff = avio::steady_us() - callback_params->timeout_start;
+    if (callback_params->aborted)
+        return 1;
+    if (diff > callback_params->timeout_us) {
         callback_params->triggered = true;
         return 1;
     }
@@ -50,6 +70,124 @@ static int interrupt_callback(void *ctx) {
 
 namespace avio {
 
+// What the camera is expected to deliver, usually the encoder configuration of the onvif profile.
+// With a hint the reader probes only enough of the stream to confirm it, rather than the default
+// five megabytes and five seconds, and probes again in full if the stream turns out different.
+class StreamHint {
+public:
+    std::string video_codec;        // onvif encoding names such as H264, H265, JPEG, or ffmpeg decoder names
+    int width = 0;
+    int height = 0;
+    float fps = 0.0f;
+    std::string audio_codec;        // AAC, G711, PCMU, PCMA, G726
+    int sample_rate = 0;
+
+    bool empty() const { return video_codec.empty() && audio_codec.empty(); }
+
+    static AVCodecID codec_id(const std::string& name) {
+        std::string str = name;
+        std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+        if (str.empty()) return AV_CODEC_ID_NONE;
+        if (str == "H264" || str == "AVC") return AV_CODEC_ID_H264;
+        if (str == "H265" || str == "HEVC") return AV_CODEC_ID_HEVC;
+        if (str == "JPEG" || str == "MJPEG") return AV_CODEC_ID_MJPEG;
+        if (str == "MPEG4") return AV_CODEC_ID_MPEG4;
+        if (str == "AAC" || str == "MP4A-LATM" || str == "MPEG4-GENERIC") return AV_CODEC_ID_AAC;
+        if (str == "G711" || str == "PCMU") return AV_CODEC_ID_PCM_MULAW;
+        if (str == "PCMA") return AV_CODEC_ID_PCM_ALAW;
+        if (str == "G726") return AV_CODEC_ID_ADPCM_G726;
+        std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+        const AVCodec* codec = avcodec_find_decoder_by_name(str.c_str());
+        return codec ? codec->id : AV_CODEC_ID_NONE;
+    }
+};
+
+class ReaderOptions {
+public:
+    int open_timeout_ms = 5000;     // connect and read the session description
+    int read_timeout_ms = 5000;     // longest wait for any single packet before the stream is considered dead
+    int probe_timeout_ms = 5000;    // avformat_find_stream_info, skipped when cached parameters are reused
+    bool reuse_parameters = false;  // reconnects take the codec parameters of the previous session instead of probing
+    StreamHint hint;
+    bool realtime = false;          // applied to the reader fields of the same name
+    bool loop = false;
+};
+
+// Codec parameters of the last successful session of each uri. A camera that drops and
+// comes back almost always returns with the same streams, so a reconnect can copy these
+// into the freshly opened context and start reading at once. Anything that disagrees with
+// what the server announced sends the reader back to a full probe.
+class ParameterCache {
+public:
+    class Entry {
+    public:
+        AVCodecParameters* par = nullptr;
+        AVRational avg_frame_rate = { 0, 1 };
+        AVRational r_frame_rate = { 0, 1 };
+        Entry(const AVStream* stream) : avg_frame_rate(stream->avg_frame_rate), r_frame_rate(stream->r_frame_rate) {
+            par = avcodec_parameters_alloc();
+            if (par) avcodec_parameters_copy(par, stream->codecpar);
+        }
+        ~Entry() { avcodec_parameters_free(&par); }
+    };
+
+    static inline std::mutex mutex;
+    static inline std::map<std::string, std::vector<std::shared_ptr<Entry>>> entries;
+
+    static void store(const std::string& uri, const AVFormatContext* fmt_ctx) {
+        // only sessions whose video dimensions are known are worth keeping
+        std::vector<std::shared_ptr<Entry>> streams;
+        for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            const AVCodecParameters* par = fmt_ctx->streams[i]->codecpar;
+            if (par->codec_type == AVMEDIA_TYPE_VIDEO && (par->width <= 0 || par->height <= 0))
+                return;
+            streams.push_back(std::make_shared<Entry>(fmt_ctx->streams[i]));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[uri] = streams;
+    }
+
+    static bool apply(const std::string& uri, AVFormatContext* fmt_ctx) {
+        std::vector<std::shared_ptr<Entry>> streams;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(uri);
+            if (it == entries.end()) return false;
+            streams = it->second;
+        }
+        if (streams.size() != fmt_ctx->nb_streams)
+            return false;
+        for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            const AVCodecParameters* announced = fmt_ctx->streams[i]->codecpar;
+            const AVCodecParameters* cached = streams[i]->par;
+            if (!cached || announced->codec_type != cached->codec_type || announced->codec_id != cached->codec_id)
+                return false;
+            // new parameter sets in the session description mean the encoder settings were changed
+            if (announced->extradata_size && (announced->extradata_size != cached->extradata_size ||
+                    memcmp(announced->extradata, cached->extradata, announced->extradata_size)))
+                return false;
+        }
+        for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            AVStream* stream = fmt_ctx->streams[i];
+            if (avcodec_parameters_copy(stream->codecpar, streams[i]->par) < 0)
+                return false;
+            stream->avg_frame_rate = streams[i]->avg_frame_rate;
+            stream->r_frame_rate = streams[i]->r_frame_rate;
+        }
+        return true;
+    }
+
+    static void forget(const std::string& uri) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.erase(uri);
+    }
+
+    static void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+};
+
 class Reader {
 public:
     std::string uri;
@@ -75,7 +213,25 @@ public:
     bool paused = false;
     bool disable_video = false;
     bool disable_audio = false;
+    bool analysis_synced = false;
+    bool realtime = false;              // pace packets to the wall clock, for files and test sources standing in for cameras
+    bool loop = false;                  // restart files from the beginning instead of closing at the end
+    int64_t loop_offset = 0;            // accumulated duration of the completed loops in AV_TIME_BASE units
+    int64_t realtime_start = AV_NOPTS_VALUE;
+    int64_t realtime_origin = AV_NOPTS_VALUE;
+    Replay* replay = nullptr;           // packets come from a capture file instead of a demuxer
+    Queue<Packet>* source = nullptr;    // packets come from a hub subscription, the context belongs to the hub
+    Capture* capture = nullptr;
+    std::mutex capture_mutex;
+    bool video_gap = false;             // video packets were lost to a full decoder queue
+    Activity* activity = nullptr;
+    Stats* stats = nullptr;
     CallbackParams callback_params;
+    ReaderOptions options;
+    bool parameters_reused = false;
+    bool probe_fallback = false;        // the hinted probe disagreed with the stream and was repeated in full
+    int64_t open_us = 0;
+    int64_t probe_us = 0;
 
     std::function<void(const std::string& uri)> packetDrop = nullptr;
     std::function<void(const std::string& msg, const std::string& uri)> infoCallback = nullptr;
@@ -84,31 +240,173 @@ public:
     void* player = nullptr;
     int64_t seek_pts = AV_NOPTS_VALUE;
 
-    Reader(const std::string& uri) : uri(uri) {
-        AVDictionary* opts = nullptr;
-        int timeout_us = MAX_TIMEOUT * 1000000;
-        av_dict_set_int(&opts, "timeout", timeout_us, 0);
-        ex.ck(avformat_open_input(&fmt_ctx, uri.c_str(), nullptr, &opts), AOI);
-        av_dict_free(&opts);
+    Reader(const std::string& uri, const std::string& format="", const ReaderOptions& options=ReaderOptions()) 
+            : uri(uri), realtime(options.realtime), loop(options.loop), options(options) {
+        if (format == "avcap" || (format.empty() && uri.length() > 6 && uri.compare(uri.length() - 6, 6, ".avcap") == 0)) {
+            AVIO_TRACE("open_input", uri);
+            replay = new Replay(uri);
+            fmt_ctx = replay->context();
+            video_stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+            audio_stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+            ex.ck((pkt = av_packet_alloc()), APA);
+            return;
+        }
+
+        // format forces the demuxer, e.g. lavfi with a uri of testsrc2=size=1280x720:rate=30
+        const AVInputFormat* input_format = nullptr;
+        if (!format.empty()) {
+            static std::once_flag devices;
+            std::call_once(devices, [] { avdevice_register_all(); });
+            if (!(input_format = av_find_input_format(format.c_str())))
+                throw std::runtime_error("unknown input format " + format);
+        }
+        int64_t start = steady_us();
+        open_input(input_format);
+        open_us = steady_us() - start;
+        if (options.reuse_parameters)
+            parameters_reused = ParameterCache::apply(uri, fmt_ctx);
+        if (!parameters_reused) {
+            bool hinted = !options.hint.empty();
+            if (hinted) {
+                // enough for the parameter sets and the first few frames of a stream whose codec is already known
+                fmt_ctx->probesize = 65536;
+                fmt_ctx->max_analyze_duration = options.hint.fps > 0 ? (int64_t)(3 * AV_TIME_BASE / options.hint.fps) : AV_TIME_BASE / 2;
+            }
+            find_stream_info();
+            if (hinted && !matches(options.hint)) {
+                probe_fallback = true;
+                avformat_close_input(&fmt_ctx);
+                open_input(input_format);
+                find_stream_info();
+            }
+            if (options.reuse_parameters)
+                ParameterCache::store(uri, fmt_ctx);
+        }
+        probe_us = steady_us() - start - open_us;
+        callback_params.triggered = false;
+        video_stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        audio_stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        ex.ck((pkt = av_packet_alloc()), APA);
+    }
+
+    void open_input(const AVInputFormat* input_format) {
+        // the interrupt callback is in place before the open so that an unreachable camera fails on time
+        ex.ck((fmt_ctx = avformat_alloc_context()), AAC);
         AVIOInterruptCB cb = { interrupt_callback, &callback_params };
         fmt_ctx->interrupt_callback = cb;
+        AVDictionary* opts = nullptr;
+        av_dict_set_int(&opts, "timeout", (int64_t)options.open_timeout_ms * 1000, 0);
+        callback_params.arm(options.open_timeout_ms);
+        AVIO_TRACE("open_input", uri);
+        int ret = avformat_open_input(&fmt_ctx, uri.c_str(), input_format, &opts);
+        av_dict_free(&opts);
+        ex.ck(ret, AOI);
+    }
+
+    void find_stream_info() {
+        AVIO_TRACE("find_stream_info", uri);
+        callback_params.arm(options.probe_timeout_ms);
         ex.ck(avformat_find_stream_info(fmt_ctx, nullptr), AFSI);
+    }
+
+    bool matches(const StreamHint& hint) const {
+        // a short probe must still have found everything the decoders need, and what the hint promised
+        bool video = false, audio = false;
+        for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            const AVCodecParameters* par = fmt_ctx->streams[i]->codecpar;
+            if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+                if (par->width <= 0 || par->height <= 0 || par->format < 0)
+                    return false;
+                if (!hint.video_codec.empty() && par->codec_id == StreamHint::codec_id(hint.video_codec) &&
+                        (!hint.width || par->width == hint.width) && (!hint.height || par->height == hint.height))
+                    video = true;
+            }
+            else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+                if (par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0 || par->format < 0)
+                    return false;
+                if (!hint.audio_codec.empty() && par->codec_id == StreamHint::codec_id(hint.audio_codec) &&
+                        (!hint.sample_rate || par->sample_rate == hint.sample_rate))
+                    audio = true;
+            }
+        }
+        return (hint.video_codec.empty() || video) && (hint.audio_codec.empty() || audio);
+    }
+
+    Reader(const std::string& uri, AVFormatContext* shared, Queue<Packet>* source) : uri(uri), source(source) {
+        // reads from a hub, the demuxer is already open and shared with the other subscribers
+        fmt_ctx = shared;
         video_stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
         audio_stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
         ex.ck((pkt = av_packet_alloc()), APA);
     }
 
     ~Reader() {
+        if (source) fmt_ctx = nullptr;
         if (fmt_ctx) {
             avformat_close_input(&fmt_ctx);
             avformat_free_context(fmt_ctx);
         }
         if (pkt) av_packet_free(&pkt);
+        if (capture) delete capture;
+        if (replay) delete replay;
+    }
+
+    int read_packet() {
+        if (source) {
+            Packet p = source->pop();
+            if (p.is_null())
+                return AVERROR_EOF;
+            av_packet_move_ref(pkt, p.pkt);
+            return 0;
+        }
+        if (replay)
+            return replay->read(pkt, realtime);
+        return av_read_frame(fmt_ctx, pkt);
+    }
+
+    int read_next() {
+        // files that loop start over at the end
+        int ret = read_packet();
+        if (ret == AVERROR_EOF && loop && rewind())
+            ret = read_packet();
+        return ret;
+    }
+
+    void prepare_packet() {
+        // capture, loop timestamps and pacing, for every packet read from the source
+        {
+            std::lock_guard<std::mutex> lock(capture_mutex);
+            if (capture) capture->write(pkt);
+        }
+
+        if (loop_offset) {
+            AVRational time_base = fmt_ctx->streams[pkt->stream_index]->time_base;
+            int64_t offset = av_rescale_q(loop_offset, AV_TIME_BASE_Q, time_base);
+            if (pkt->pts != AV_NOPTS_VALUE) pkt->pts += offset;
+            if (pkt->dts != AV_NOPTS_VALUE) pkt->dts += offset;
+        }
+
+        if (realtime && !replay && !source)
+            pace();
+    }
+
+    void start_capture(const std::string& filename) {
+        // the raw packets are written as they arrive, ahead of any pacing or timestamp changes
+        Capture* arg = new Capture(filename, fmt_ctx);
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        if (capture) delete capture;
+        capture = arg;
+    }
+
+    void stop_capture() {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        if (capture) delete capture;
+        capture = nullptr;
     }
 
     int read() {
         try {
-            callback_params.timeout_start = time(nullptr);
+            callback_params.arm(options.read_timeout_ms);
 
             if (seek_pts != AV_NOPTS_VALUE) {
                 clear_callback(player);
@@ -121,33 +419,75 @@ public:
                 }
                 if (seek_pts < last_pts)
                     flags |= AVSEEK_FLAG_BACKWARD;
-                av_seek_frame(fmt_ctx, seek_index, seek_pts, flags);
-                ex.eof(av_read_frame(fmt_ctx, pkt), ARF);
+                if (replay)
+                    replay->seek(seek_index, seek_pts - av_rescale_q(loop_offset, AV_TIME_BASE_Q, fmt_ctx->streams[seek_index]->time_base));
+                else
+                    av_seek_frame(fmt_ctx, seek_index, seek_pts, flags);
+                ex.eof(read_packet(), ARF);
                 clear_callback(player);
                 seek_pts = AV_NOPTS_VALUE;
             }
             else {
-                ex.eof(av_read_frame(fmt_ctx, pkt), ARF);
+                AVIO_TRACE("read_frame", uri);
+                ex.eof(read_next(), ARF);
             }
             if (closed)
                 return 0;
 
+            prepare_packet();
+
+            if (stats) {
+                stats->reader.in++;
+                stats->reader.update_cpu();
+                if (pkt->stream_index == video_stream_index)
+                    stats->arrived(pkt->pts);
+            }
+
+            if (activity && pkt->stream_index == video_stream_index)
+                activity->push(pkt->size, pkt->flags & AV_PKT_FLAG_KEY);
+
             if (writer_pkts) {
-                writer_pkts->push(Packet(pkt));
+                Packet p(pkt);
+                if (p.stream_index() == video_stream_index && video_pkts) {
+                    // analysis of a hidden stream must never hold up the recording, so packets are offered
+                    // rather than pushed, and after a drop nothing is offered again until the next key frame
+                    if (p.is_key_frame())
+                        analysis_synced = true;
+                    if (analysis_synced && !video_pkts->try_push(Packet(p))) {
+                        analysis_synced = false;
+                        if (stats) stats->reader.dropped++;
+                    }
+                }
+                writer_pkts->push(std::move(p));
+                if (stats) stats->reader.out++;
             }
             else {
                 if (pkt->stream_index == video_stream_index && video_pkts) {
                     last_video_pts = pkt->pts;
+                    if (packetDrop && video_gap && !video_pkts->full()) {
+                        // the decoder is told where packets went missing, and resumes at the next key frame
+                        // rather than on a broken reference chain
+                        AVPacket* gap = av_packet_alloc();
+                        gap->data = (uint8_t*)"GAP";
+                        video_pkts->push(Packet(gap));
+                        av_packet_free(&gap);
+                        video_gap = false;
+                    }
                     if (packetDrop && video_pkts->full()) {
+                        Packet term(pkt);
                         packetDrop(uri);
+                        video_gap = true;
+                        if (stats) stats->reader.dropped++;
                     }
                     else {
                         video_pkts->push(Packet(pkt));
+                        if (stats) stats->reader.out++;
                     }
                 }
                 else if (pkt->stream_index == audio_stream_index && audio_pkts) {
                     last_audio_pts = pkt->pts;
                     audio_pkts->push(Packet(pkt));
+                    if (stats) stats->reader.out++;
                 }
                 else {
                     Packet term(pkt);
@@ -173,6 +513,35 @@ public:
         return closed ? 0 : 1;
     }
 
+    bool rewind() {
+        // the next pass continues the timestamps of the last so that downstream stages see one long stream
+        int64_t length = fmt_ctx->duration;
+        if (length == AV_NOPTS_VALUE || length <= 0)
+            return false;
+        if (replay)
+            replay->rewind();
+        else if (av_seek_frame(fmt_ctx, -1, fmt_ctx->start_time == AV_NOPTS_VALUE ? 0 : fmt_ctx->start_time, AVSEEK_FLAG_BACKWARD) < 0)
+            return false;
+        loop_offset += length;
+        return true;
+    }
+
+    void pace() {
+        // holds each packet back until its presentation time, measured from the first packet read
+        if (pkt->pts == AV_NOPTS_VALUE)
+            return;
+        int64_t pts_us = av_rescale_q(pkt->pts, fmt_ctx->streams[pkt->stream_index]->time_base, AV_TIME_BASE_Q);
+        int64_t now = av_gettime_relative();
+        if (realtime_start == AV_NOPTS_VALUE) {
+            realtime_start = now;
+            realtime_origin = pts_us;
+            return;
+        }
+        int64_t delay = (pts_us - realtime_origin) - (now - realtime_start);
+        if (delay > 0 && delay < 1000000 && !terminated)
+            std::this_thread::sleep_for(std::chrono::microseconds(delay));
+    }
+
     void terminate() {
         if (video_pkts && !closed && !terminated) {
             video_pkts->clear();
@@ -188,6 +557,12 @@ public:
             writer_pkts->push(Packet(nullptr));
             writer_pkts = nullptr;
         }
+        if (source) {
+            source->clear();
+            source->push(Packet(nullptr));
+        }
+        if (replay)
+            replay->aborted = true;
         closed = true;
         terminated = true;
     }
@@ -0,0 +1,288 @@
+/********************************************************************
+* libavio/include/Restream.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef RESTREAM_HPP
+#define RESTREAM_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+#include "Hub.hpp"
+#include "Stats.hpp"
+
+namespace avio {
+
+// Serves the camera streams to remote viewers as fragmented mp4 over http, without
+// transcoding. Each path is mapped to a camera uri, and every client of a path is a hub
+// subscriber, so any number of viewers share the one camera session. A client starts with
+// the latest key frame, or the next one if it is the only viewer of the camera, and has its
+// own bounded queue, a client that cannot keep up skips to the next key frame without slowing
+// the camera or the other viewers.
+//
+//     restream = Restream("http://0.0.0.0:8554")
+//     restream.add("/front", "rtsp://...")
+//     ffplay http://127.0.0.1:8554/front
+
+class RestreamClient {
+public:
+    std::string path;
+    std::string uri;
+    AVIOContext* io = nullptr;
+    std::thread* thread = nullptr;
+    std::shared_ptr<Hub> hub;
+    std::shared_ptr<HubSubscriber> sub;
+    std::atomic<bool> done { false };
+    std::atomic<int64_t> sent { 0 };
+    std::atomic<int64_t> bytes { 0 };
+    int64_t started_us = 0;
+
+    ~RestreamClient() {
+        if (thread) {
+            thread->join();
+            delete thread;
+        }
+    }
+};
+
+class Restream {
+public:
+    std::string address;
+    int client_queue = 256;         // packets a client may fall behind before it skips to the next key frame
+    int max_clients = 32;
+    std::map<std::string, std::string> paths;
+    std::vector<std::shared_ptr<RestreamClient>> clients;
+    AVIOContext* server = nullptr;
+    std::thread* thread = nullptr;
+    std::atomic<bool> running { false };
+    std::mutex mutex;
+
+    std::function<void(const std::string& msg, const std::string& uri)> infoCallback = nullptr;
+
+    Restream(const std::string& address="http://0.0.0.0:8554") : address(address) { }
+    ~Restream() { stop(); }
+
+    void add(const std::string& path, const std::string& uri) {
+        std::lock_guard<std::mutex> lock(mutex);
+        paths[path.size() && path[0] == '/' ? path : "/" + path] = uri;
+    }
+
+    void remove(const std::string& path) {
+        // clients already watching the path keep their stream until they disconnect
+        std::lock_guard<std::mutex> lock(mutex);
+        paths.erase(path.size() && path[0] == '/' ? path : "/" + path);
+    }
+
+    static int interrupt(void* ctx) {
+        return !((Restream*)ctx)->running;
+    }
+
+    void start() {
+        if (running) return;
+        AVDictionary* opts = nullptr;
+        av_dict_set(&opts, "listen", "2", 0);
+        AVIOInterruptCB cb = { interrupt, this };
+        running = true;
+        int ret = avio_open2(&server, address.c_str(), AVIO_FLAG_WRITE, &cb, &opts);
+        av_dict_free(&opts);
+        if (ret < 0) {
+            running = false;
+            ExceptionChecker ex;
+            ex.ck(ret, "restream server could not listen on " + address);
+        }
+        thread = new std::thread([&] { Trace::set_thread_name("restream " + address); while (accept()) {} });
+    }
+
+    void stop() {
+        if (!running) return;
+        running = false;
+        if (thread) {
+            thread->join();
+            delete thread;
+            thread = nullptr;
+        }
+        std::vector<std::shared_ptr<RestreamClient>> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& client : clients)
+                if (client->sub) client->sub->close();
+            finished.swap(clients);
+        }
+        finished.clear();
+        avio_closep(&server);
+    }
+
+    int accept() {
+        AVIOContext* io = nullptr;
+        int ret = avio_accept(server, &io);
+        if (!running) {
+            if (io) avio_closep(&io);
+            return 0;
+        }
+        if (ret < 0)
+            return 1;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                [](const std::shared_ptr<RestreamClient>& c) { return c->done.load(); }), clients.end());
+        std::shared_ptr<RestreamClient> client = std::make_shared<RestreamClient>();
+        client->io = io;
+        client->started_us = steady_us();
+        RestreamClient* c = client.get();
+        client->thread = new std::thread([this, c] { serve(c); });
+        clients.push_back(client);
+        return 1;
+    }
+
+    void serve(RestreamClient* client) {
+        // one thread per client, so a slow network only ever stalls its own viewer
+        AVFormatContext* out = nullptr;
+        bool header = false;
+        try {
+            int ret = 0;
+            while ((ret = avio_handshake(client->io)) > 0) {
+                uint8_t* resource = nullptr;
+                if (av_opt_get(client->io, "resource", AV_OPT_SEARCH_CHILDREN, &resource) >= 0 && resource) {
+                    client->path = (const char*)resource;
+                    av_freep(&resource);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto it = paths.find(client->path);
+                    int active = 0;
+                    for (auto& c : clients) if (!c->done) active++;
+                    int code = 200;
+                    if (it == paths.end()) code = 404;
+                    else if (active > max_clients) code = 503;
+                    else client->uri = it->second;
+                    av_opt_set_int(client->io, "reply_code", code, AV_OPT_SEARCH_CHILDREN);
+                    av_opt_set(client->io, "content_type", "video/mp4", AV_OPT_SEARCH_CHILDREN);
+                }
+            }
+            if (ret < 0 || client->uri.empty())
+                throw std::runtime_error("request for " + client->path + " was refused");
+
+            client->hub = Hub::open(client->uri);
+            client->sub = client->hub->attach("restream " + std::to_string(client->started_us), client_queue, DROP_TO_KEY_FRAME, true);
+            if (!running) client->sub->close();
+            if (client->sub->truncated && infoCallback)
+                infoCallback("the gop of " + client->uri + " is longer than the hub caches, the client starts at the next key frame", client->uri);
+            AVFormatContext* in = client->hub->context();
+
+            ExceptionChecker ex;
+            ex.ck(avformat_alloc_output_context2(&out, nullptr, "mp4", nullptr), AAOC2);
+            std::vector<int> index(in->nb_streams, -1);
+            for (unsigned i = 0; i < in->nb_streams; i++) {
+                const AVCodecParameters* par = in->streams[i]->codecpar;
+                if (par->codec_type != AVMEDIA_TYPE_VIDEO && par->codec_type != AVMEDIA_TYPE_AUDIO)
+                    continue;
+                if (avformat_query_codec(out->oformat, par->codec_id, FF_COMPLIANCE_NORMAL) != 1)
+                    continue;
+                AVStream* stream = nullptr;
+                ex.ck(stream = avformat_new_stream(out, nullptr), ANS);
+                ex.ck(avcodec_parameters_copy(stream->codecpar, par), "avcodec_parameters_copy");
+                stream->codecpar->codec_tag = 0;
+                stream->time_base = in->streams[i]->time_base;
+                index[i] = stream->index;
+            }
+            if (!out->nb_streams)
+                throw std::runtime_error("no stream of " + client->uri + " can be carried in mp4");
+
+            // fragments start at every key frame and nothing waits for the end of the stream
+            out->pb = client->io;
+            out->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+            AVDictionary* opts = nullptr;
+            av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+            ret = avformat_write_header(out, &opts);
+            av_dict_free(&opts);
+            ex.ck(ret, AWH);
+            header = true;
+            if (infoCallback) infoCallback("restream client connected to " + client->path, client->uri);
+
+            int64_t origin = AV_NOPTS_VALUE;
+            while (running) {
+                Packet p = client->sub->pkts.pop();
+                if (p.is_null()) break;
+                int i = p.stream_index();
+                if (i < 0 || i >= (int)index.size() || index[i] < 0) continue;
+                AVPacket* pkt = p.pkt;
+                if (pkt->dts == AV_NOPTS_VALUE) pkt->dts = pkt->pts;
+                if (pkt->pts == AV_NOPTS_VALUE) pkt->pts = pkt->dts;
+                if (pkt->dts == AV_NOPTS_VALUE) continue;
+                // timestamps are made relative to the first packet the client receives
+                if (origin == AV_NOPTS_VALUE)
+                    origin = av_rescale_q(pkt->dts, in->streams[i]->time_base, AV_TIME_BASE_Q);
+                int64_t offset = av_rescale_q(origin, AV_TIME_BASE_Q, in->streams[i]->time_base);
+                pkt->pts -= offset;
+                pkt->dts -= offset;
+                pkt->stream_index = index[i];
+                av_packet_rescale_ts(pkt, in->streams[i]->time_base, out->streams[index[i]]->time_base);
+                if (pkt->dts < 0) continue;
+                int bytes = pkt->size;
+                if (av_write_frame(out, pkt) < 0)
+                    break;
+                client->sent++;
+                client->bytes += bytes;
+            }
+        }
+        catch (const std::exception& e) {
+            if (infoCallback) infoCallback(std::string("restream client error: ") + e.what(), client->uri);
+        }
+
+        if (client->hub) client->hub->detach(client->sub);
+        client->hub.reset();
+        if (out) {
+            if (header) av_write_trailer(out);
+            out->pb = nullptr;
+            avformat_free_context(out);
+        }
+        avio_closep(&client->io);
+        if (infoCallback && !client->uri.empty()) infoCallback("restream client disconnected from " + client->path, client->uri);
+        client->done = true;
+    }
+
+    std::vector<std::map<std::string, std::string>> connections() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::map<std::string, std::string>> result;
+        for (auto& client : clients) {
+            if (client->done) continue;
+            result.push_back({
+                { "path", client->path },
+                { "uri", client->uri },
+                { "packets", std::to_string(client->sent.load()) },
+                { "bytes", std::to_string(client->bytes.load()) },
+                { "dropped", std::to_string(client->sub ? client->sub->dropped.load() : 0) },
+                { "seconds", std::to_string((steady_us() - client->started_us) / 1000000) }
+            });
+        }
+        return result;
+    }
+};
+
+}
+
+#endif // RESTREAM_HPP
@@ -0,0 +1,188 @@
+/********************************************************************
+* libavio/include/Scheduler.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "Frame.hpp"
+
+namespace avio {
+
+// Shares a fixed analysis budget, in frames per second, among all of the players. Each player
+// holds at most one pending frame, a newer frame replaces an older one that has not been
+// analyzed yet, so the backlog can never grow. Analysis workers block in next() for a slot.
+
+class Slot {
+public:
+    std::string uri;
+    int priority = 0;
+    Frame pending { nullptr };
+    std::chrono::steady_clock::time_point arrived;
+    std::chrono::steady_clock::time_point served;
+    std::deque<std::chrono::steady_clock::time_point> history;
+    int64_t submitted = 0;
+    int64_t analyzed = 0;
+    int64_t dropped = 0;
+};
+
+class Scheduler {
+public:
+    float budget = 10.0f;           // analyzed frames per second across all players, zero for unlimited
+    bool use_priority = false;      // round robin when false, otherwise highest priority first
+    int max_age_ms = 500;           // pending frames older than this are discarded instead of analyzed
+    float window_seconds = 2.0f;    // averaging window for the effective fps
+
+    std::map<std::string, Slot> slots;
+    std::chrono::steady_clock::time_point next_slot = std::chrono::steady_clock::now();
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    Scheduler(float budget=10.0f) : budget(budget) { }
+
+    void submit(const std::string& uri, const Frame& f) {
+        if (f.is_null()) return;
+        std::unique_lock<std::mutex> lock(mutex);
+        Slot& slot = slots[uri];
+        slot.uri = uri;
+        if (!slot.pending.is_null())
+            slot.dropped++;
+        slot.pending = f;
+        slot.arrived = std::chrono::steady_clock::now();
+        slot.submitted++;
+        lock.unlock();
+        cv.notify_one();
+    }
+
+    // blocks until the budget allows another analysis and a frame is waiting, returns false when closed
+    bool next(std::string& uri, Frame& f) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!closed) {
+            auto now = std::chrono::steady_clock::now();
+            if (budget > 0 && now < next_slot) {
+                cv.wait_until(lock, next_slot);
+                continue;
+            }
+
+            Slot* slot = select(now);
+            if (!slot) {
+                cv.wait_for(lock, std::chrono::milliseconds(100));
+                continue;
+            }
+
+            uri = slot->uri;
+            f = std::move(slot->pending);
+            slot->served = now;
+            slot->analyzed++;
+            slot->history.push_back(now);
+            trim(slot->history, now);
+
+            if (budget > 0) {
+                // a budget left unused while idle does not accumulate into a burst
+                auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.0f / budget));
+                next_slot = std::max(next_slot, now) + interval;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    Slot* select(std::chrono::steady_clock::time_point now) {
+        // caller holds the mutex, stale frames are dropped along the way
+        Slot* best = nullptr;
+        for (auto& [uri, slot] : slots) {
+            if (slot.pending.is_null()) continue;
+            if (max_age_ms > 0 && now - slot.arrived > std::chrono::milliseconds(max_age_ms)) {
+                slot.pending = Frame(nullptr);
+                slot.dropped++;
+                continue;
+            }
+            if (!best) {
+                best = &slot;
+                continue;
+            }
+            if (use_priority && slot.priority != best->priority) {
+                if (slot.priority > best->priority) best = &slot;
+                continue;
+            }
+            // the camera that has waited longest since it was last served goes next
+            if (slot.served < best->served) best = &slot;
+        }
+        return best;
+    }
+
+    void set_priority(const std::string& uri, int priority) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Slot& slot = slots[uri];
+        slot.uri = uri;
+        slot.priority = priority;
+    }
+
+    void remove(const std::string& uri) {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots.erase(uri);
+    }
+
+    void trim(std::deque<std::chrono::steady_clock::time_point>& history, std::chrono::steady_clock::time_point now) {
+        auto cutoff = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(window_seconds));
+        while (history.size() && history.front() < cutoff)
+            history.pop_front();
+    }
+
+    float fps(const std::string& uri) {
+        // effective analysis rate of one camera over the averaging window
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = slots.find(uri);
+        if (it == slots.end())
+            return 0.0f;
+        trim(it->second.history, std::chrono::steady_clock::now());
+        return it->second.history.size() / window_seconds;
+    }
+
+    std::map<std::string, float> rates() {
+        std::vector<std::string> uris;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& [uri, slot] : slots)
+                uris.push_back(uri);
+        }
+        std::map<std::string, float> result;
+        for (const std::string& uri : uris)
+            result[uri] = fps(uri);
+        return result;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        cv.notify_all();
+    }
+};
+
+}
+
+#endif // SCHEDULER_HPP
@@ -0,0 +1,256 @@
+/********************************************************************
+* libavio/include/Snapshot.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdio>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "Frame.hpp"
+#include "Exception.hpp"
+#include "Detect.hpp"
+#include "Trace.hpp"
+
+namespace avio {
+
+// Jpeg snapshots of the decoded stream, for alarms and thumbnails, without asking the camera
+// for an image over http. Every player shares one encoder thread, which keeps an open mjpeg
+// encoder for each frame size it has seen so that a snapshot costs a scale and an encode.
+// Detection boxes may be drawn into the image, given in the coordinates of the source frame.
+
+class SnapshotJob {
+public:
+    Frame frame;
+    std::string path;                   // empty to return the jpeg to the caller instead of writing a file
+    int quality = 90;                   // 1 to 100
+    int max_size = 0;                   // longest side of the image, zero keeps the frame size
+    std::vector<Detection> boxes;
+    std::promise<std::vector<uint8_t>> result;
+    std::function<void(const std::string& error)> errorCallback = nullptr;     // for a caller that does not wait on the result
+};
+
+class SnapshotEncoder {
+public:
+    size_t max_encoders = 8;
+    std::map<std::pair<int, int>, AVCodecContext*> encoders;
+    SwsContext* sws_ctx = nullptr;
+    std::deque<std::unique_ptr<SnapshotJob>> jobs;
+    std::thread* thread = nullptr;
+    bool running = true;
+    std::mutex mutex;
+    std::condition_variable cv;
+    ExceptionChecker ex;
+
+    static SnapshotEncoder& shared() {
+        static SnapshotEncoder encoder;
+        return encoder;
+    }
+
+    SnapshotEncoder() {
+        thread = new std::thread([&] { Trace::set_thread_name("snapshot"); while (run()) {} });
+    }
+
+    ~SnapshotEncoder() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        cv.notify_all();
+        thread->join();
+        delete thread;
+        for (auto& [size, ctx] : encoders)
+            avcodec_free_context(&ctx);
+        if (sws_ctx) sws_freeContext(sws_ctx);
+    }
+
+    std::future<std::vector<uint8_t>> submit(std::unique_ptr<SnapshotJob> job) {
+        std::future<std::vector<uint8_t>> future = job->result.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+        return future;
+    }
+
+    int run() {
+        std::unique_ptr<SnapshotJob> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return !running || !jobs.empty(); });
+            if (!running) {
+                for (auto& pending : jobs)
+                    pending->result.set_exception(std::make_exception_ptr(std::runtime_error("snapshot encoder closed")));
+                jobs.clear();
+                return 0;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        try {
+            AVIO_TRACE("snapshot", job->path);
+            std::vector<uint8_t> jpeg = encode(*job);
+            if (job->path.length()) {
+                FILE* file = fopen(job->path.c_str(), "wb");
+                if (!file)
+                    throw std::runtime_error("unable to open snapshot file " + job->path);
+                size_t written = fwrite(jpeg.data(), 1, jpeg.size(), file);
+                fclose(file);
+                if (written != jpeg.size())
+                    throw std::runtime_error("unable to write snapshot file " + job->path);
+            }
+            job->result.set_value(std::move(jpeg));
+        }
+        catch (const std::exception& e) {
+            if (job->errorCallback) job->errorCallback(e.what());
+            job->result.set_exception(std::current_exception());
+        }
+        return 1;
+    }
+
+    AVCodecContext* encoder(int width, int height) {
+        // one open context per frame size, mjpeg is intra only so a context can be used again right away
+        std::pair<int, int> size = { width, height };
+        auto it = encoders.find(size);
+        if (it != encoders.end())
+            return it->second;
+        if (encoders.size() >= max_encoders) {
+            avcodec_free_context(&encoders.begin()->second);
+            encoders.erase(encoders.begin());
+        }
+
+        const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+        if (!codec)
+            throw std::runtime_error("mjpeg encoder is not available");
+        AVCodecContext* ctx = nullptr;
+        ex.ck(ctx = avcodec_alloc_context3(codec), AAC3);
+        ctx->width = width;
+        ctx->height = height;
+        ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+        ctx->color_range = AVCOL_RANGE_JPEG;
+        ctx->time_base = { 1, 25 };
+        ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        int ret = avcodec_open2(ctx, codec, nullptr);
+        if (ret < 0) {
+            avcodec_free_context(&ctx);
+            ex.ck(ret, AO2);
+        }
+        encoders[size] = ctx;
+        return ctx;
+    }
+
+    std::vector<uint8_t> encode(const SnapshotJob& job) {
+        const AVFrame* src = job.frame.frame;
+        if (!src || !src->width || !src->height)
+            throw std::runtime_error("snapshot frame is empty");
+
+        int w = src->width;
+        int h = src->height;
+        if (job.max_size > 0 && std::max(w, h) > job.max_size) {
+            float scale = (float)job.max_size / std::max(w, h);
+            w = std::max(2, (int)(w * scale));
+            h = std::max(2, (int)(h * scale));
+        }
+        w &= ~1;
+        h &= ~1;
+
+        Frame image;
+        image.frame->format = AV_PIX_FMT_YUVJ420P;
+        image.frame->width = w;
+        image.frame->height = h;
+        ex.ck(av_frame_get_buffer(image.frame, 0), AFGB);
+        ex.ck(sws_ctx = sws_getCachedContext(sws_ctx, src->width, src->height, (AVPixelFormat)src->format,
+                w, h, AV_PIX_FMT_YUVJ420P, SWS_BILINEAR, nullptr, nullptr, nullptr), SGC);
+        sws_scale(sws_ctx, src->data, src->linesize, 0, src->height, image.frame->data, image.frame->linesize);
+
+        float sx = (float)w / src->width;
+        float sy = (float)h / src->height;
+        for (const Detection& d : job.boxes)
+            draw_box(image.frame, (int)(d.x1 * sx), (int)(d.y1 * sy), (int)(d.x2 * sx), (int)(d.y2 * sy), d.label, std::max(2, w / 320));
+
+        // quality 100 is qscale 2 and quality 1 is qscale 31, the range of the mjpeg quantizer
+        int quality = std::clamp(job.quality, 1, 100);
+        int qscale = 2 + ((100 - quality) * 29 + 49) / 99;
+        AVCodecContext* ctx = encoder(w, h);
+        ctx->global_quality = image.frame->quality = FF_QP2LAMBDA * qscale;
+        image.frame->pts = AV_NOPTS_VALUE;
+
+        ex.ck(avcodec_send_frame(ctx, image.frame), "avcodec_send_frame");
+        AVPacket* pkt = av_packet_alloc();
+        int ret = avcodec_receive_packet(ctx, pkt);
+        std::vector<uint8_t> jpeg;
+        if (ret >= 0)
+            jpeg.assign(pkt->data, pkt->data + pkt->size);
+        av_packet_free(&pkt);
+        ex.ck(ret, ARP);
+        return jpeg;
+    }
+
+    static void draw_box(AVFrame* f, int x1, int y1, int x2, int y2, int label, int thickness) {
+        // outline in the yuvj420p image, the chroma planes are half size in both directions
+        static const uint8_t palette[][3] = {
+            { 0, 255, 0 }, { 255, 64, 64 }, { 64, 128, 255 }, { 255, 255, 0 },
+            { 255, 0, 255 }, { 0, 255, 255 }, { 255, 160, 0 }, { 255, 255, 255 }
+        };
+        const uint8_t* rgb = palette[(label < 0 ? 0 : label) % 8];
+        uint8_t Y = (uint8_t)std::clamp(0.299f * rgb[0] + 0.587f * rgb[1] + 0.114f * rgb[2], 0.0f, 255.0f);
+        uint8_t U = (uint8_t)std::clamp(128.0f - 0.1687f * rgb[0] - 0.3313f * rgb[1] + 0.5f * rgb[2], 0.0f, 255.0f);
+        uint8_t V = (uint8_t)std::clamp(128.0f + 0.5f * rgb[0] - 0.4187f * rgb[1] - 0.0813f * rgb[2], 0.0f, 255.0f);
+
+        x1 = std::clamp(x1, 0, f->width - 1);
+        x2 = std::clamp(x2, 0, f->width - 1);
+        y1 = std::clamp(y1, 0, f->height - 1);
+        y2 = std::clamp(y2, 0, f->height - 1);
+        if (x2 <= x1 || y2 <= y1) return;
+
+        auto fill = [&](int left, int top, int right, int bottom) {
+            for (int y = top; y <= bottom; y++)
+                std::fill(f->data[0] + y * f->linesize[0] + left, f->data[0] + y * f->linesize[0] + right + 1, Y);
+            for (int y = top / 2; y <= bottom / 2; y++) {
+                std::fill(f->data[1] + y * f->linesize[1] + left / 2, f->data[1] + y * f->linesize[1] + right / 2 + 1, U);
+                std::fill(f->data[2] + y * f->linesize[2] + left / 2, f->data[2] + y * f->linesize[2] + right / 2 + 1, V);
+            }
+        };
+        int t = thickness - 1;
+        fill(x1, y1, x2, std::min(y1 + t, y2));
+        fill(x1, std::max(y2 - t, y1), x2, y2);
+        fill(x1, y1, std::min(x1 + t, x2), y2);
+        fill(std::max(x2 - t, x1), y1, x2, y2);
+    }
+};
+
+}
+
+#endif // SNAPSHOT_HPP
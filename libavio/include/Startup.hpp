@@ -0,0 +1,272 @@
+/********************************************************************
+* libavio/include/Startup.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef STARTUP_HPP
+#define STARTUP_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "Stats.hpp"
+
+namespace avio {
+
+// Staggers the start of many players. Each player waits in acquire() for one of a limited
+// number of opening slots, highest priority first, then oldest first, so the tiles that are
+// visible or focused connect before the rest. The slot covers the connection, the probe and
+// the decoder setup, and a stream that fails to open is retried after an exponential backoff
+// with random jitter so that cameras behind one switch do not all come back in the same instant.
+
+enum StartupState {
+    STARTUP_IDLE = 0,
+    STARTUP_QUEUED = 1,
+    STARTUP_OPENING = 2,
+    STARTUP_RUNNING = 3,
+    STARTUP_RETRY = 4,
+    STARTUP_FAILED = 5,
+    STARTUP_CANCELLED = 6
+};
+
+class StartupEntry {
+public:
+    int handle = 0;
+    std::string uri;
+    int priority = 0;
+    int state = STARTUP_IDLE;
+    int attempts = 0;
+    int64_t queued_us = 0;
+    int64_t next_attempt_us = 0;
+    int64_t opening_us = 0;
+    int64_t wait_us = 0;            // total time spent queued or backing off before the successful attempt
+    int64_t open_us = 0;
+    int64_t probe_us = 0;
+    int64_t init_us = 0;            // decoders, filters and threads after the stream was opened
+    bool cancelled = false;         // cancelled while opening, takes effect when the slot is given back
+    std::string error;
+};
+
+class Startup {
+public:
+    int max_concurrent = 4;         // streams allowed to be connecting, probing or initializing at once
+    int max_attempts = 3;           // zero retries forever
+    int backoff_ms = 500;           // first retry delay, doubled on each attempt
+    int max_backoff_ms = 10000;
+    float jitter = 0.5f;            // fraction of the delay that is randomized
+
+    std::map<int, StartupEntry> entries;        // one per player, so players of the same uri keep their own state
+    int next_handle = 1;
+    int active = 0;
+    std::mt19937 random { std::random_device{}() };
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    Startup(int max_concurrent=4) : max_concurrent(max_concurrent) { }
+
+    int add(const std::string& uri, int priority=0) {
+        // the handle identifies the player in the other calls, it is kept across reconnects
+        std::lock_guard<std::mutex> lock(mutex);
+        StartupEntry& entry = entries[next_handle];
+        entry.handle = next_handle++;
+        entry.uri = uri;
+        entry.priority = priority;
+        return entry.handle;
+    }
+
+    void remove(int handle) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end()) return;
+        if (it->second.state == STARTUP_OPENING) active--;
+        entries.erase(it);
+        lock.unlock();
+        cv.notify_all();
+    }
+
+    bool acquire(int handle, bool retry=false) {
+        // blocks until the stream may open, false if it was cancelled or removed, including a cancel
+        // that came before the first attempt or between attempts, a retry keeps its place and attempts
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end() || it->second.state == STARTUP_CANCELLED)
+            return false;
+        if (!retry || it->second.state != STARTUP_RETRY) {
+            StartupEntry& entry = it->second;
+            entry.state = STARTUP_QUEUED;
+            entry.attempts = 0;
+            entry.queued_us = steady_us();
+            entry.next_attempt_us = 0;
+            entry.cancelled = false;
+            entry.error.clear();
+        }
+        StartupEntry* entry = nullptr;
+        while (true) {
+            // remove() may erase the entry while this thread waits, so it is looked up after every wake
+            it = entries.find(handle);
+            if (it == entries.end() || it->second.state == STARTUP_CANCELLED)
+                return false;
+            entry = &it->second;
+            int64_t now = steady_us();
+            if (entry->next_attempt_us > now) {
+                cv.wait_for(lock, std::chrono::microseconds(entry->next_attempt_us - now));
+                continue;
+            }
+            if (active < max_concurrent && next_in_line() == entry)
+                break;
+            cv.wait(lock);
+        }
+        active++;
+        entry->state = STARTUP_OPENING;
+        entry->attempts++;
+        entry->opening_us = steady_us();
+        entry->wait_us = entry->opening_us - entry->queued_us;
+        return true;
+    }
+
+    void opened(int handle, int64_t open_us, int64_t probe_us) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end()) return;
+        it->second.open_us = open_us;
+        it->second.probe_us = probe_us;
+    }
+
+    void ready(int handle) {
+        // the stream is playing, its slot goes to the next one in line
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end() || it->second.state != STARTUP_OPENING) return;
+        StartupEntry& entry = it->second;
+        entry.state = entry.cancelled ? STARTUP_CANCELLED : STARTUP_RUNNING;
+        entry.init_us = steady_us() - entry.opening_us - entry.open_us - entry.probe_us;
+        active--;
+        lock.unlock();
+        cv.notify_all();
+    }
+
+    bool failed(int handle, const std::string& error) {
+        // releases the slot, returns true if the stream should call acquire again for another attempt
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end() || it->second.state != STARTUP_OPENING) return false;
+        StartupEntry& entry = it->second;
+        active--;
+        entry.error = error;
+        if (entry.cancelled || (max_attempts && entry.attempts >= max_attempts)) {
+            entry.state = entry.cancelled ? STARTUP_CANCELLED : STARTUP_FAILED;
+            lock.unlock();
+            cv.notify_all();
+            return false;
+        }
+        int64_t delay = std::min((int64_t)max_backoff_ms, (int64_t)backoff_ms << std::min(entry.attempts - 1, 20));
+        std::uniform_real_distribution<float> spread(1.0f - jitter, 1.0f);
+        entry.next_attempt_us = steady_us() + (int64_t)(delay * 1000 * spread(random));
+        entry.state = STARTUP_RETRY;
+        lock.unlock();
+        cv.notify_all();
+        return true;
+    }
+
+    void release(int handle) {
+        // safe to call on any exit path, only a stream still holding a slot gives it up
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end() || it->second.state != STARTUP_OPENING) return;
+        it->second.state = it->second.cancelled ? STARTUP_CANCELLED : STARTUP_FAILED;
+        active--;
+        lock.unlock();
+        cv.notify_all();
+    }
+
+    void cancel(int handle) {
+        // a stream that is opening keeps its slot until it reports back, and is not retried
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end()) return;
+        StartupEntry& entry = it->second;
+        if (entry.state == STARTUP_IDLE || entry.state == STARTUP_QUEUED || entry.state == STARTUP_RETRY)
+            entry.state = STARTUP_CANCELLED;
+        else if (entry.state == STARTUP_OPENING)
+            entry.cancelled = true;
+        lock.unlock();
+        cv.notify_all();
+    }
+
+    void set_priority(int handle, int priority) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end()) return;
+        it->second.priority = priority;
+        lock.unlock();
+        cv.notify_all();
+    }
+
+    int position(int handle) {
+        // place in the queue, zero is next to open, -1 once the stream has left the queue
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<StartupEntry*> waiting = queue();
+        for (size_t i = 0; i < waiting.size(); i++)
+            if (waiting[i]->handle == handle) return (int)i;
+        return -1;
+    }
+
+    std::map<std::string, double> timings(int handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(handle);
+        if (it == entries.end()) return {};
+        const StartupEntry& entry = it->second;
+        return {
+            { "state", (double)entry.state },
+            { "attempts", (double)entry.attempts },
+            { "wait_ms", entry.wait_us / 1000.0 },
+            { "open_ms", entry.open_us / 1000.0 },
+            { "probe_ms", entry.probe_us / 1000.0 },
+            { "init_ms", entry.init_us / 1000.0 }
+        };
+    }
+
+    std::vector<StartupEntry*> queue() {
+        // streams waiting for a slot in the order they will get one, the caller holds the mutex
+        std::vector<StartupEntry*> result;
+        int64_t now = steady_us();
+        for (auto& [handle, entry] : entries) {
+            if (entry.state == STARTUP_QUEUED || (entry.state == STARTUP_RETRY && entry.next_attempt_us <= now))
+                result.push_back(&entry);
+        }
+        std::sort(result.begin(), result.end(), [](const StartupEntry* a, const StartupEntry* b) {
+            if (a->priority != b->priority) return a->priority > b->priority;
+            return a->queued_us < b->queued_us;
+        });
+        return result;
+    }
+
+    StartupEntry* next_in_line() {
+        std::vector<StartupEntry*> waiting = queue();
+        return waiting.empty() ? nullptr : waiting.front();
+    }
+};
+
+}
+
+#endif // STARTUP_HPP
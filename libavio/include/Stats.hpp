@@ -0,0 +1,282 @@
+/********************************************************************
+* libavio/include/Stats.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <string>
+#include <map>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace avio {
+
+static int64_t thread_cpu_us() {
+    // cpu time consumed by the calling thread
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (int64_t)((k + u) / 10);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return 0;
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static int64_t process_cpu_us() {
+    // cpu time consumed by all threads of the process
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (int64_t)((k + u) / 10);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts))
+        return 0;
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static int64_t steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Log linear histogram in the style of HdrHistogram, each power of two is split into
+// sixteen buckets, so any recorded value is known to within about six percent.
+class Histogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB = 1 << SUB_BITS;
+    static const int SIZE = 48 * SUB;
+
+    std::array<std::atomic<uint32_t>, SIZE> counts;
+    std::atomic<int64_t> total { 0 };
+    std::atomic<int64_t> max { 0 };
+
+    Histogram() { reset(); }
+
+    static int bucket(uint64_t v) {
+        if (v < SUB) return (int)v;
+        int msb = 63;
+        while (!(v >> msb)) msb--;
+        int index = (msb - SUB_BITS + 1) * SUB + (int)((v >> (msb - SUB_BITS)) & (SUB - 1));
+        return std::min(index, SIZE - 1);
+    }
+
+    static uint64_t lower_bound(int index) {
+        if (index < SUB) return index;
+        int group = index / SUB;
+        return (uint64_t)(SUB + index % SUB) << (group - 1);
+    }
+
+    void record(int64_t value) {
+        if (value < 0) value = 0;
+        counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        int64_t current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+    }
+
+    int64_t percentile(double pct) const {
+        int64_t n = total.load(std::memory_order_relaxed);
+        if (!n) return 0;
+        int64_t target = (int64_t)std::ceil(n * pct / 100.0);
+        int64_t seen = 0;
+        for (int i = 0; i < SIZE; i++) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= target)
+                return (int64_t)((lower_bound(i) + lower_bound(i + 1)) / 2);
+        }
+        return max.load(std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for (std::atomic<uint32_t>& c : counts) c.store(0, std::memory_order_relaxed);
+        total = 0;
+        max = 0;
+    }
+};
+
+class StageStats {
+public:
+    std::atomic<int64_t> in { 0 };
+    std::atomic<int64_t> out { 0 };
+    std::atomic<int64_t> dropped { 0 };
+    std::atomic<int64_t> skipped { 0 };            // discarded while the stage had no consumer
+    std::atomic<int64_t> queue_high_water { 0 };
+    std::atomic<int64_t> cpu_us { 0 };
+
+    void queue_depth(int64_t depth) {
+        int64_t current = queue_high_water.load(std::memory_order_relaxed);
+        while (depth > current && !queue_high_water.compare_exchange_weak(current, depth, std::memory_order_relaxed)) { }
+    }
+
+    void update_cpu() {
+        // must be called from the thread that runs the stage
+        cpu_us.store(thread_cpu_us(), std::memory_order_relaxed);
+    }
+
+    void reset() {
+        in = out = dropped = skipped = queue_high_water = cpu_us = 0;
+    }
+
+    std::map<std::string, double> snapshot() const {
+        return {
+            { "in", (double)in.load() },
+            { "out", (double)out.load() },
+            { "dropped", (double)dropped.load() },
+            { "skipped", (double)skipped.load() },
+            { "queue_high_water", (double)queue_high_water.load() },
+            { "cpu_ms", cpu_us.load() / 1000.0 }
+        };
+    }
+};
+
+// Counters for every stage of one player, reset each time the stream is opened. Video packet
+// arrival times are kept in a small ring keyed by pts so that the display can measure the
+// latency of each frame from the moment its packet was read.
+class Stats {
+public:
+    StageStats reader;
+    StageStats video_decoder;
+    StageStats audio_decoder;
+    StageStats video_filter;
+    StageStats audio_filter;
+    StageStats display;
+    StageStats audio;
+    StageStats writer;
+    Histogram latency;
+
+    // startup, measured from the time the player starts to open the stream
+    std::atomic<int64_t> start_us { 0 };
+    std::atomic<int64_t> open_us { 0 };
+    std::atomic<int64_t> probe_us { 0 };
+    std::atomic<int64_t> first_frame_us { -1 };
+    std::atomic<bool> probe_fallback { false };
+
+    static const int RING = 512;
+    std::array<std::pair<int64_t, int64_t>, RING> arrivals;
+    int arrival_index = 0;
+    std::mutex mutex;
+
+    Stats() { reset(); }
+
+    void arrived(int64_t pts) {
+        std::lock_guard<std::mutex> lock(mutex);
+        arrivals[arrival_index] = { pts, steady_us() };
+        arrival_index = (arrival_index + 1) % RING;
+    }
+
+    void first_frame() {
+        // called for every decoded video frame, only the first one after a reset is kept
+        if (first_frame_us.load(std::memory_order_relaxed) >= 0)
+            return;
+        int64_t expected = -1;
+        first_frame_us.compare_exchange_strong(expected, steady_us() - start_us.load());
+    }
+
+    int64_t displayed(int64_t pts) {
+        // returns the latency of the frame in microseconds, or -1 if its packet is no longer in the ring
+        int64_t arrival = -1;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // most recent entries are the likeliest match, so search backwards from the newest
+            for (int i = 1; i <= RING; i++) {
+                const std::pair<int64_t, int64_t>& entry = arrivals[(arrival_index - i + RING) % RING];
+                if (entry.first == pts) {
+                    arrival = entry.second;
+                    break;
+                }
+            }
+        }
+        if (arrival < 0)
+            return -1;
+        int64_t result = steady_us() - arrival;
+        latency.record(result);
+        return result;
+    }
+
+    void reset() {
+        for (StageStats* s : { &reader, &video_decoder, &audio_decoder, &video_filter, &audio_filter, &display, &audio, &writer })
+            s->reset();
+        latency.reset();
+        start_us = steady_us();
+        open_us = probe_us = 0;
+        first_frame_us = -1;
+        probe_fallback = false;
+        std::lock_guard<std::mutex> lock(mutex);
+        arrivals.fill({ AV_NOPTS_VALUE, -1 });
+        arrival_index = 0;
+    }
+
+    std::map<std::string, std::map<std::string, double>> snapshot() const {
+        std::map<std::string, std::map<std::string, double>> result;
+        result["reader"] = reader.snapshot();
+        result["video_decoder"] = video_decoder.snapshot();
+        result["audio_decoder"] = audio_decoder.snapshot();
+        result["video_filter"] = video_filter.snapshot();
+        result["audio_filter"] = audio_filter.snapshot();
+        result["display"] = display.snapshot();
+        result["audio"] = audio.snapshot();
+        result["writer"] = writer.snapshot();
+        result["latency"] = {
+            { "count", (double)latency.total.load() },
+            { "p50_ms", latency.percentile(50) / 1000.0 },
+            { "p90_ms", latency.percentile(90) / 1000.0 },
+            { "p99_ms", latency.percentile(99) / 1000.0 },
+            { "max_ms", latency.max.load() / 1000.0 }
+        };
+        result["startup"] = {
+            { "open_ms", open_us.load() / 1000.0 },
+            { "probe_ms", probe_us.load() / 1000.0 },
+            { "first_frame_ms", first_frame_us.load() < 0 ? -1.0 : first_frame_us.load() / 1000.0 },
+            { "probe_fallback", probe_fallback.load() ? 1.0 : 0.0 }
+        };
+        return result;
+    }
+};
+
+}
+
+#endif // STATS_HPP
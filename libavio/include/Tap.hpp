@@ -0,0 +1,149 @@
+/********************************************************************
+* libavio/include/Tap.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef TAP_HPP
+#define TAP_HPP
+
+#include <iostream>
+#include <functional>
+#include <chrono>
+#include <atomic>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include "Frame.hpp"
+#include "Queue.hpp"
+#include "Exception.hpp"
+#include "Trace.hpp"
+
+namespace avio {
+
+// Base class for native analyzers attached to a player's frame stream. The stream never
+// waits on a tap, each tap runs on its own thread and takes the newest frame it can keep
+// up with. Subclasses implement analyze() and report results through emit().
+
+struct TapEvent {
+    std::string name;
+    std::string uri;
+    float value = 0.0f;
+    int64_t pts = AV_NOPTS_VALUE;
+};
+
+class Tap {
+public:
+    std::string name;
+    std::string uri;
+    Queue<Frame> frames;
+    AVMediaType media_type = AVMEDIA_TYPE_VIDEO;
+    bool filtered = false;                      // attach after the filter rather than at the decoder
+    float max_fps = 0.0f;                       // rate limit, zero accepts every frame
+    AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;    // frames are converted when a format or size is set
+    int width = 0;
+    int height = 0;
+    std::atomic<int64_t> frames_dropped { 0 };  // written by the pipeline thread, read from others
+    std::chrono::steady_clock::time_point last_accepted;
+    SwsContext* sws_ctx = nullptr;
+    ExceptionChecker ex;
+
+    std::function<void(const TapEvent& event)> eventCallback = nullptr;
+
+    Tap(const std::string& name, const std::string& uri) : name(name), uri(uri), frames(1) { }
+
+    virtual ~Tap() {
+        if (sws_ctx) sws_freeContext(sws_ctx);
+    }
+
+    virtual void analyze(const Frame& f) = 0;
+
+    virtual void push(const Frame& f) {
+        if (f.is_null()) return;
+        if (max_fps > 0.0f) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_accepted < std::chrono::duration<float>(1.0f / max_fps))
+                return;
+            last_accepted = now;
+        }
+        if (!frames.try_push(Frame(f)))
+            frames_dropped++;
+    }
+
+    void open() {
+        frames.clear();
+    }
+
+    void close() {
+        frames.clear();
+        frames.push(Frame(nullptr));
+    }
+
+    int run() {
+        Frame f = frames.pop();
+        if (f.is_null())
+            return 0;
+
+        try {
+            AVIO_TRACE("tap", uri);
+            if (media_type == AVMEDIA_TYPE_VIDEO && (pix_fmt != AV_PIX_FMT_NONE || width || height))
+                analyze(convert(f));
+            else
+                analyze(f);
+        }
+        catch (const std::exception& e) {
+            std::cout << uri << " " << name << " exception: " << e.what() << std::endl;
+        }
+        return 1;
+    }
+
+    Frame convert(const Frame& f) {
+        // conversion happens on the tap thread so that it never costs the decoder any time
+        AVPixelFormat src_fmt = (AVPixelFormat)f.format();
+        AVPixelFormat dst_fmt = (pix_fmt == AV_PIX_FMT_NONE) ? src_fmt : pix_fmt;
+        int w = width ? width : f.width();
+        int h = height ? height : f.height();
+        if (dst_fmt == src_fmt && w == f.width() && h == f.height())
+            return f;
+
+        ex.ck(sws_ctx = sws_getCachedContext(sws_ctx, f.width(), f.height(), src_fmt, w, h, dst_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr), SGC);
+        Frame result;
+        result.frame->format = dst_fmt;
+        result.frame->width = w;
+        result.frame->height = h;
+        ex.ck(av_frame_get_buffer(result.frame, 0), AFGB);
+        ex.ck(av_frame_copy_props(result.frame, f.frame), AFCP);
+        ex.ck(sws_scale(sws_ctx, f.frame->data, f.frame->linesize, 0, f.height(), result.frame->data, result.frame->linesize), SS);
+        return result;
+    }
+
+    void emit(float value, int64_t pts=AV_NOPTS_VALUE) {
+        if (!eventCallback) return;
+        TapEvent event;
+        event.name = name;
+        event.uri = uri;
+        event.value = value;
+        event.pts = pts;
+        eventCallback(event);
+    }
+};
+
+}
+
+#endif // TAP_HPP
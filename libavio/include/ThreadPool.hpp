@@ -0,0 +1,120 @@
+/********************************************************************
+* libavio/include/ThreadPool.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <string>
+#include <stdexcept>
+
+namespace avio {
+
+class ThreadPool {
+public:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::mutex call_mutex;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+    std::function<void(int)> job = nullptr;
+    std::atomic<int> next { 0 };
+    int job_count = 0;
+    int active = 0;
+    uint64_t generation = 0;
+    bool running = true;
+    std::string error;
+
+    ThreadPool(int size=0) {
+        if (size <= 0)
+            size = std::max(1, (int)std::thread::hardware_concurrency());
+        for (int i = 0; i < size; i++)
+            workers.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        cv_work.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    int size() const { return (int)workers.size(); }
+
+    // runs fn(0) ... fn(n-1) across the pool and returns when all of them have finished
+    void parallel_for(int n, const std::function<void(int)>& fn) {
+        if (n <= 0) return;
+        std::lock_guard<std::mutex> call_lock(call_mutex);
+        std::unique_lock<std::mutex> lock(mutex);
+        job = fn;
+        job_count = n;
+        next = 0;
+        active = (int)workers.size();
+        error.clear();
+        generation++;
+        cv_work.notify_all();
+        cv_done.wait(lock, [&] { return active == 0; });
+        job = nullptr;
+        if (error.length())
+            throw std::runtime_error(error);
+    }
+
+    void work() {
+        uint64_t seen = 0;
+        while (true) {
+            std::function<void(int)> fn;
+            int n = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv_work.wait(lock, [&] { return !running || generation != seen; });
+                if (!running) return;
+                seen = generation;
+                fn = job;
+                n = job_count;
+            }
+
+            int i;
+            while ((i = next++) < n) {
+                try {
+                    fn(i);
+                }
+                catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (error.empty()) error = e.what();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0)
+                cv_done.notify_all();
+        }
+    }
+};
+
+}
+
+#endif // THREADPOOL_HPP
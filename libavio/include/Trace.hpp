@@ -0,0 +1,209 @@
+/********************************************************************
+* libavio/include/Trace.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+
+namespace avio {
+
+// Span tracing for the pipeline threads. Each thread writes begin and end events into its
+// own ring, so recording costs an uncontended lock and a few stores, and nothing at all
+// while tracing is disabled. dump() writes the chrome trace event format, which loads in
+// chrome://tracing and in the perfetto ui.
+//
+//     AVIO_TRACE("decode", uri);   // the span lasts until the end of the enclosing scope
+
+struct TraceEvent {
+    int64_t ts = 0;             // microseconds on the steady clock
+    const char* name = nullptr; // string literal
+    int uri = -1;
+    char phase = 'B';
+};
+
+class TraceRing {
+public:
+    std::vector<TraceEvent> events;
+    size_t next = 0;
+    bool wrapped = false;
+    int tid = 0;
+    std::string thread_name;
+    std::mutex mutex;
+
+    TraceRing(size_t size, int tid) : events(size), tid(tid) { }
+
+    void add(const char* name, int uri, char phase) {
+        std::lock_guard<std::mutex> lock(mutex);
+        TraceEvent& e = events[next];
+        e.ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        e.name = name;
+        e.uri = uri;
+        e.phase = phase;
+        if (++next == events.size()) {
+            next = 0;
+            wrapped = true;
+        }
+    }
+};
+
+class Trace {
+public:
+    static inline std::atomic<bool> enabled { false };
+    static inline size_t ring_size = 16384;
+    static inline std::mutex mutex;
+    static inline std::vector<std::shared_ptr<TraceRing>> rings;
+    static inline std::vector<std::string> uris;
+
+    static TraceRing* ring() {
+        // rings outlive their threads so that the events of finished streams can still be dumped
+        thread_local std::shared_ptr<TraceRing> local;
+        if (!local) {
+            std::lock_guard<std::mutex> lock(mutex);
+            local = std::make_shared<TraceRing>(ring_size, (int)rings.size() + 1);
+            rings.push_back(local);
+        }
+        return local.get();
+    }
+
+    static int intern(const std::string& uri) {
+        // pipeline threads each serve one stream, so the last lookup nearly always matches
+        thread_local std::string last;
+        thread_local int last_id = -1;
+        if (last_id >= 0 && uri == last)
+            return last_id;
+        std::lock_guard<std::mutex> lock(mutex);
+        int id = -1;
+        for (size_t i = 0; i < uris.size(); i++) {
+            if (uris[i] == uri) {
+                id = (int)i;
+                break;
+            }
+        }
+        if (id < 0) {
+            id = (int)uris.size();
+            uris.push_back(uri);
+        }
+        last = uri;
+        last_id = id;
+        return id;
+    }
+
+    static void begin(const char* name, const std::string& uri) {
+        ring()->add(name, intern(uri), 'B');
+    }
+
+    static void end(const char* name, const std::string& uri) {
+        ring()->add(name, intern(uri), 'E');
+    }
+
+    static void set_thread_name(const std::string& name) {
+        if (!enabled.load(std::memory_order_relaxed)) return;
+        TraceRing* r = ring();
+        std::lock_guard<std::mutex> lock(r->mutex);
+        r->thread_name = name;
+    }
+
+    static void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::shared_ptr<TraceRing>& r : rings) {
+            std::lock_guard<std::mutex> ring_lock(r->mutex);
+            r->next = 0;
+            r->wrapped = false;
+        }
+    }
+
+    static std::string escape(const std::string& str) {
+        std::string result;
+        for (char c : str) {
+            if (c == '"' || c == '\\') result += '\\';
+            if ((unsigned char)c < 0x20) continue;
+            result += c;
+        }
+        return result;
+    }
+
+    static std::string json() {
+        std::stringstream str;
+        str << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::shared_ptr<TraceRing>& r : rings) {
+            std::lock_guard<std::mutex> ring_lock(r->mutex);
+            if (r->thread_name.length()) {
+                str << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->tid
+                    << ",\"args\":{\"name\":\"" << escape(r->thread_name) << "\"}}";
+                first = false;
+            }
+            size_t count = r->wrapped ? r->events.size() : r->next;
+            size_t start = r->wrapped ? r->next : 0;
+            for (size_t i = 0; i < count; i++) {
+                const TraceEvent& e = r->events[(start + i) % r->events.size()];
+                str << (first ? "" : ",") << "{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase
+                    << "\",\"ts\":" << e.ts << ",\"pid\":1,\"tid\":" << r->tid;
+                if (e.uri >= 0 && (size_t)e.uri < uris.size())
+                    str << ",\"args\":{\"uri\":\"" << escape(uris[e.uri]) << "\"}";
+                str << "}";
+                first = false;
+            }
+        }
+        str << "]}";
+        return str.str();
+    }
+
+    static void dump(const std::string& filename) {
+        std::ofstream file(filename);
+        if (!file.is_open())
+            throw std::runtime_error("unable to open trace file " + filename);
+        file << json();
+    }
+};
+
+class TraceScope {
+public:
+    const char* name = nullptr;
+    const std::string* uri = nullptr;
+
+    TraceScope(const char* name, const std::string& uri) {
+        if (!Trace::enabled.load(std::memory_order_relaxed)) return;
+        this->name = name;
+        this->uri = &uri;
+        Trace::begin(name, uri);
+    }
+
+    ~TraceScope() {
+        if (name) Trace::end(name, *uri);
+    }
+};
+
+#define AVIO_TRACE_CONCAT_(a, b) a##b
+#define AVIO_TRACE_CONCAT(a, b) AVIO_TRACE_CONCAT_(a, b)
+#define AVIO_TRACE(name, uri) avio::TraceScope AVIO_TRACE_CONCAT(avio_trace_, __LINE__)(name, uri)
+
+}
+
+#endif // TRACE_HPP
@@ -0,0 +1,260 @@
+/********************************************************************
+* libavio/include/Tracker.hpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#ifndef TRACKER_HPP
+#define TRACKER_HPP
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+#include "Detect.hpp"
+
+namespace avio {
+
+// SORT style tracker that carries detector boxes across the frames in between detector runs.
+// Box centers and sizes are each followed by a constant velocity kalman filter, detections are
+// matched to tracks greedily by IoU within the same class. For each frame call predict(),
+// then run the detector and pass its boxes to update() only if needs_detection() is true.
+
+class Kalman {
+public:
+    float p = 0.0f;             // position
+    float v = 0.0f;             // velocity per frame
+    float P00 = 0.0f, P01 = 0.0f, P11 = 0.0f;
+
+    void init(float z, float var_p, float var_v) {
+        p = z;
+        v = 0.0f;
+        P00 = var_p;
+        P01 = 0.0f;
+        P11 = var_v;
+    }
+
+    void predict(float q_p, float q_v) {
+        p += v;
+        P00 += 2 * P01 + P11 + q_p;
+        P01 += P11;
+        P11 += q_v;
+    }
+
+    void update(float z, float r) {
+        float s = P00 + r;
+        float k0 = P00 / s;
+        float k1 = P01 / s;
+        float y = z - p;
+        p += k0 * y;
+        v += k1 * y;
+        P11 -= k1 * P01;
+        P01 -= k0 * P01;
+        P00 -= k0 * P00;
+    }
+};
+
+class Track {
+public:
+    int id = 0;
+    int label = -1;
+    float score = 0.0f;
+    Kalman cx, cy, w, h;
+    int hits = 0;               // detector runs that matched this track
+    int misses = 0;             // consecutive detector runs without a match
+    bool confirmed = false;
+    std::chrono::steady_clock::time_point first_seen;
+    std::chrono::steady_clock::time_point last_seen;
+
+    float x1() const { return cx.p - width() / 2; }
+    float y1() const { return cy.p - height() / 2; }
+    float x2() const { return cx.p + width() / 2; }
+    float y2() const { return cy.p + height() / 2; }
+    float width()  const { return std::max(1.0f, w.p); }
+    float height() const { return std::max(1.0f, h.p); }
+
+    float dwell() const {
+        // seconds since the track was first detected
+        return std::chrono::duration<float>(last_seen - first_seen).count();
+    }
+
+    float uncertainty() const {
+        // standard deviation of the predicted center relative to the box size
+        return std::sqrt(std::max(cx.P00, cy.P00)) / std::max(width(), height());
+    }
+
+    Detection box() const {
+        Detection d;
+        d.x1 = x1(); d.y1 = y1(); d.x2 = x2(); d.y2 = y2();
+        d.score = score;
+        d.label = label;
+        return d;
+    }
+};
+
+class Tracker {
+public:
+    float iou_threshold = 0.3f;
+    int min_hits = 2;           // detector runs before a track is reported
+    int max_misses = 3;         // detector runs without a match before a track is dropped
+    int min_interval = 1;       // frames between detector runs, adaptive scheduling stays inside this range
+    int max_interval = 5;
+    float max_uncertainty = 0.25f;
+    float pos_noise = 1.0f / 20.0f;
+    float vel_noise = 1.0f / 160.0f;
+
+    std::vector<Track> tracks;
+    std::map<int, int> counts;  // confirmed tracks per label since the last reset
+    int next_id = 1;
+    int frames_since_detection = 0;
+    int64_t detections_run = 0;
+    int64_t frames_seen = 0;
+    std::mutex mutex;
+
+    void predict() {
+        // called once for every frame, including the ones the detector does not see
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Track& t : tracks) {
+            float size = std::max(t.width(), t.height());
+            float q_p = std::pow(pos_noise * size, 2);
+            float q_v = std::pow(vel_noise * size, 2);
+            t.cx.predict(q_p, q_v);
+            t.cy.predict(q_p, q_v);
+            t.w.predict(q_p, q_v);
+            t.h.predict(q_p, q_v);
+        }
+        frames_since_detection++;
+        frames_seen++;
+    }
+
+    bool needs_detection() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (frames_since_detection < min_interval)
+            return false;
+        if (frames_since_detection >= max_interval)
+            return true;
+        // tentative tracks need confirmation and drifting tracks need correction
+        for (const Track& t : tracks) {
+            if (!t.confirmed || t.uncertainty() > max_uncertainty)
+                return true;
+        }
+        return false;
+    }
+
+    void update(const std::vector<Detection>& detections) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+
+        struct Pair { float iou; int track; int detection; };
+        std::vector<Pair> pairs;
+        for (int i = 0; i < (int)tracks.size(); i++) {
+            Detection b = tracks[i].box();
+            for (int j = 0; j < (int)detections.size(); j++) {
+                if (detections[j].label != b.label) continue;
+                float iou = Detect::iou(b, detections[j]);
+                if (iou >= iou_threshold)
+                    pairs.push_back({ iou, i, j });
+            }
+        }
+        std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) { return a.iou > b.iou; });
+
+        std::vector<bool> track_used(tracks.size(), false);
+        std::vector<bool> detection_used(detections.size(), false);
+        for (const Pair& pair : pairs) {
+            if (track_used[pair.track] || detection_used[pair.detection]) continue;
+            track_used[pair.track] = true;
+            detection_used[pair.detection] = true;
+            correct(tracks[pair.track], detections[pair.detection], now);
+        }
+
+        for (int i = 0; i < (int)tracks.size(); i++) {
+            if (!track_used[i])
+                tracks[i].misses++;
+        }
+        tracks.erase(std::remove_if(tracks.begin(), tracks.end(),
+            [&](const Track& t) { return t.misses > max_misses || (!t.confirmed && t.misses > 0); }), tracks.end());
+
+        for (int j = 0; j < (int)detections.size(); j++) {
+            if (!detection_used[j])
+                tracks.push_back(create(detections[j], now));
+        }
+
+        frames_since_detection = 0;
+        detections_run++;
+    }
+
+    Track create(const Detection& d, std::chrono::steady_clock::time_point now) {
+        Track t;
+        t.id = next_id++;
+        t.label = d.label;
+        t.score = d.score;
+        float w = d.x2 - d.x1;
+        float h = d.y2 - d.y1;
+        float size = std::max(w, h);
+        float var_p = std::pow(2 * pos_noise * size, 2);
+        float var_v = std::pow(10 * vel_noise * size, 2);
+        t.cx.init(d.x1 + w / 2, var_p, var_v);
+        t.cy.init(d.y1 + h / 2, var_p, var_v);
+        t.w.init(w, var_p, var_v);
+        t.h.init(h, var_p, var_v);
+        t.hits = 1;
+        t.first_seen = t.last_seen = now;
+        if (min_hits <= 1) confirm(t);
+        return t;
+    }
+
+    void correct(Track& t, const Detection& d, std::chrono::steady_clock::time_point now) {
+        float w = d.x2 - d.x1;
+        float h = d.y2 - d.y1;
+        float r = std::pow(pos_noise * std::max(w, h), 2);
+        t.cx.update(d.x1 + w / 2, r);
+        t.cy.update(d.y1 + h / 2, r);
+        t.w.update(w, r);
+        t.h.update(h, r);
+        t.score = d.score;
+        t.hits++;
+        t.misses = 0;
+        t.last_seen = now;
+        if (!t.confirmed && t.hits >= min_hits) confirm(t);
+    }
+
+    void confirm(Track& t) {
+        t.confirmed = true;
+        counts[t.label]++;
+    }
+
+    std::vector<Track> confirmed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Track> result;
+        for (const Track& t : tracks)
+            if (t.confirmed) result.push_back(t);
+        return result;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        tracks.clear();
+        counts.clear();
+        frames_since_detection = 0;
+    }
+};
+
+}
+
+#endif // TRACKER_HPP
@@ -47,6 +47,7 @@ public:
     int64_t video_next_pts;
     int64_t audio_next_pts;
     Queue<Packet>* input = nullptr;
+    StageStats* stats = nullptr;
     Queue<Packet> video_cache;
     Queue<Packet> audio_cache;
     bool disable_video = false;
@@ -134,7 +135,9 @@ public:
         try {
             if (((pkt->stream_index == reader->video_stream_index) && !disable_video) || ((pkt->stream_index == reader->audio_stream_index) && !disable_audio)) {
                 adjust_pts(pkt);
+                AVIO_TRACE("write_packet", reader->uri);
                 ex.ck(av_interleaved_write_frame(fmt_ctx, pkt), AIWF);
+                if (stats) stats->out++;
             }
         }
         catch (const std::exception& e) {
@@ -192,13 +195,16 @@ public:
     }
 
     int write() {
+        if (stats) stats->queue_depth(input->size());
         Packet pkt = input->pop();
+        if (stats && !pkt.is_null()) stats->in++;
         //if (reader->recording && !reader->closed && !reader->terminated && !pkt.is_null()) {
         // there's an issue here with how the stream closes, either video or audio could send
         // a null packet first when using post decode mode
         if (reader->recording && !pkt.is_null()) {
             try {
                 if (!fmt_ctx) {
+                    AVIO_TRACE("writer_open", reader->uri);
                     open(filename);
                     write_cache();
                 }
@@ -218,6 +224,7 @@ public:
         }
 
         push_cache_pkt(std::move(pkt));
+        if (stats) stats->update_cpu();
         return 1;        
     }
 
@@ -297,6 +304,7 @@ public:
         }
         if (fmt_ctx) {
             try {
+                AVIO_TRACE("writer_close", reader->uri);
                 avio_flush(fmt_ctx->pb);
                 ex.ck(av_write_trailer(fmt_ctx), AWT);
                 ex.ck(avio_closep(&fmt_ctx->pb), ACP);
@@ -20,15 +20,64 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/functional.h>
+#include <pybind11/numpy.h>
 #include "Player.hpp"
 #include "Reader.hpp"
 #include "Frame.hpp"
 #include "Audio.hpp"
+#include "Batch.hpp"
+#include "Compositor.hpp"
+#include "Detect.hpp"
+#include "Tracker.hpp"
+#include "Scheduler.hpp"
+#include "Admission.hpp"
+#include "Startup.hpp"
+#include "Restream.hpp"
+#include "FrameBus.hpp"
+#include "Snapshot.hpp"
+#include "Trace.hpp"
 
 namespace py = pybind11;
 
 namespace avio {
 
+static std::string plane_format(const PlaneShape& shape) {
+    if (shape.is_float)
+        return shape.element_size == 2 ? "e" : py::format_descriptor<float>::format();
+    if (shape.element_size == 2) return py::format_descriptor<uint16_t>::format();
+    if (shape.element_size == 4) return py::format_descriptor<uint32_t>::format();
+    return py::format_descriptor<uint8_t>::format();
+}
+
+static py::array plane_array(py::object base, const uint8_t* data, int linesize, const PlaneShape& shape) {
+    // rows x columns, with a third dimension for planes holding more than one component, the
+    // base object stays alive for as long as the array refers to its memory, which is read only
+    // because it is shared with the other consumers of the frame or mapped from another process
+    std::vector<py::ssize_t> dims = { shape.rows, shape.cols };
+    std::vector<py::ssize_t> strides = { linesize, (py::ssize_t)shape.element_size * shape.channels };
+    if (shape.channels > 1) {
+        dims.push_back(shape.channels);
+        strides.push_back(shape.element_size);
+    }
+    py::array result(py::dtype(plane_format(shape)), dims, strides, data, base);
+    result.attr("flags").attr("writeable") = false;
+    return result;
+}
+
+static py::array plane_array(py::object self, int i) {
+    const Frame& f = self.cast<const Frame&>();
+    if (i < 0 || i >= f.planes())
+        throw std::out_of_range("frame has no plane " + std::to_string(i));
+    return plane_array(self, f.frame->data[i], f.frame->linesize[i], f.plane(i));
+}
+
+static py::array plane_array(py::object self, const SharedFrame& f, int i) {
+    int planes = f.is_null() ? 0 : av_pix_fmt_count_planes((AVPixelFormat)f.format);
+    if (i < 0 || i >= planes)
+        throw std::out_of_range("shared frame has no plane " + std::to_string(i));
+    return plane_array(self, f.data[i], f.linesize[i], plane_shape(f.format, f.width, f.height, i));
+}
+
 PYBIND11_MODULE(avio, m)
 {
     m.doc() = "pybind11 av plugin";
@@ -43,6 +92,17 @@ PYBIND11_MODULE(avio, m)
         .def("height", &Player::height)
         .def("isPaused", &Player::isPaused)
         .def("isRecording", &Player::isRecording)
+        .def("isCapturing", &Player::isCapturing)
+        .def("getLatency", &Player::getLatency)
+        .def("setLatencyTarget", &Player::setLatencyTarget)
+        .def("getShedLevel", &Player::getShedLevel)
+        .def("isDecodingVideo", &Player::isDecodingVideo)
+        .def("isDecodingAudio", &Player::isDecodingAudio)
+        .def("getTimeToFirstFrame", &Player::getTimeToFirstFrame)
+        .def("getStartupPosition", &Player::getStartupPosition)
+        .def("getStartupTimings", &Player::getStartupTimings)
+        .def("startCapture", &Player::startCapture)
+        .def("stopCapture", &Player::stopCapture)
         .def("isMuted", &Player::isMuted)
         .def("isCameraStream", &Player::isCameraStream)
         .def("setVolume", &Player::setVolume)
@@ -55,8 +115,48 @@ PYBIND11_MODULE(avio, m)
         .def("toggleRecording", &Player::toggleRecording)
         .def("startFileBreak", &Player::startFileBreak)
         .def("getAudioCodec", &Player::getAudioCodec)
+        .def("getMotionLevel", &Player::getMotionLevel)
+        .def("getActivityLevel", &Player::getActivityLevel)
+        .def("getLatestFrame", &Player::getLatestFrame)
+        .def("publishFrames", &Player::publishFrames, py::arg("name"), py::arg("pix_fmt")="", py::arg("width")=0, py::arg("height")=0, py::arg("slots")=4)
+        .def("getFrameBusName", &Player::getFrameBusName)
+        .def("captureSnapshot", [](Player& p, const std::string& path, int quality, int max_size, py::object boxes) -> py::object {
+            // boxes are the (n, 6) arrays returned by Detect.process, the jpeg is returned as bytes when there is no path
+            std::vector<Detection> detections;
+            if (!boxes.is_none()) {
+                py::array_t<float, py::array::c_style | py::array::forcecast> array = boxes.cast<py::array_t<float, py::array::c_style | py::array::forcecast>>();
+                if (array.size() && (array.ndim() != 2 || array.shape(1) < 4))
+                    throw std::runtime_error("snapshot boxes must have rows of x1, y1, x2, y2");
+                detections.resize(array.size() ? array.shape(0) : 0);
+                const float* d = array.data();
+                for (Detection& det : detections) {
+                    det.x1 = d[0]; det.y1 = d[1]; det.x2 = d[2]; det.y2 = d[3];
+                    if (array.shape(1) > 5) det.label = (int)d[5];
+                    d += array.shape(1);
+                }
+            }
+            std::vector<uint8_t> jpeg;
+            {
+                py::gil_scoped_release release;
+                jpeg = p.captureSnapshot(path, quality, max_size, detections);
+            }
+            if (path.length())
+                return py::none();
+            return py::bytes((const char*)jpeg.data(), jpeg.size());
+        }, py::arg("path")="", py::arg("quality")=90, py::arg("max_size")=0, py::arg("boxes")=py::none())
+        .def("setScheduler", &Player::setScheduler, py::keep_alive<1, 2>())
+        .def("setAdmission", &Player::setAdmission, py::keep_alive<1, 2>())
+        .def("setAdmissionPriority", &Player::setAdmissionPriority)
+        .def("setStartupPriority", &Player::setStartupPriority)
+        .def("setStartup", &Player::setStartup, py::keep_alive<1, 2>())
+        .def("setMotionGain", &Player::setMotionGain)
+        .def("setMotionThreshold", &Player::setMotionThreshold)
+        .def("setMotionMask", &Player::setMotionMask)
+        .def("getMotionHeatmap", &Player::getMotionHeatmap)
+        .def("getMotionHeatmapSize", &Player::getMotionHeatmapSize)
         .def("clearBuffer", &Player::clearBuffer)
         .def("getStreamInfo", &Player::getStreamInfo)
+        .def("getStats", &Player::getStats)
         .def("getFFMPEGVersions", &Player::getFFMPEGVersions)
         .def("getAudioDrivers", &Player::getAudioDrivers)
         .def("getHardwareDecoders", &Player::getHardwareDecoders)
@@ -69,6 +169,10 @@ PYBIND11_MODULE(avio, m)
         .def_readwrite("disable_video", &Player::disable_video)
         .def_readwrite("disable_audio", &Player::disable_audio)
         .def_readwrite("hidden", &Player::hidden)
+        .def_readwrite("visible", &Player::visible)
+        .def_readwrite("analyze_video", &Player::analyze_video)
+        .def_readwrite("analyze_audio", &Player::analyze_audio)
+        .def_readwrite("lazy_decode", &Player::lazy_decode)
         .def_readwrite("progressCallback", &Player::progressCallback)
         .def_readwrite("renderCallback", &Player::renderCallback)
         .def_readwrite("pyAudioCallback", &Player::pyAudioCallback)
@@ -77,8 +181,28 @@ PYBIND11_MODULE(avio, m)
         .def_readwrite("mediaPlayingStarted", &Player::mediaPlayingStarted)
         .def_readwrite("mediaPlayingStopped", &Player::mediaPlayingStopped)
         .def_readwrite("packetDrop", &Player::packetDrop)
+        .def_readwrite("motionCallback", &Player::motionCallback)
+        .def_readwrite("eventCallback", &Player::eventCallback)
+        .def_readwrite("latencyCallback", &Player::latencyCallback)
+        .def_readwrite("latency_target", &Player::latency_target)
+        .def_readwrite("motion_detect", &Player::motion_detect)
+        .def_readwrite("motion_scale", &Player::motion_scale)
+        .def_readwrite("motion_vectors", &Player::motion_vectors)
+        .def_readwrite("vector_threshold", &Player::vector_threshold)
+        .def_readwrite("activity_detect", &Player::activity_detect)
         .def_readwrite("str_video_filter", &Player::str_video_filter)
         .def_readwrite("str_audio_filter", &Player::str_audio_filter)
+        .def_readwrite("input_format", &Player::input_format)
+        .def_readwrite("realtime", &Player::realtime)
+        .def_readwrite("loop", &Player::loop)
+        .def_readwrite("open_timeout", &Player::open_timeout)
+        .def_readwrite("read_timeout", &Player::read_timeout)
+        .def_readwrite("probe_timeout", &Player::probe_timeout)
+        .def_readwrite("fast_reconnect", &Player::fast_reconnect)
+        .def_readwrite("stream_hint", &Player::stream_hint)
+        .def_readwrite("shared_ingest", &Player::shared_ingest)
+        .def_readwrite("admission_priority", &Player::admission_priority)
+        .def_readwrite("startup_priority", &Player::startup_priority)
         .def_readwrite("audio_driver_index", &Player::audio_driver_index)
         .def_readwrite("str_hw_device_type", &Player::str_hw_device_type)
         .def_readwrite("onvif_frame_rate", &Player::onvif_frame_rate)
@@ -120,6 +244,35 @@ PYBIND11_MODULE(avio, m)
         .def("stride", &Frame::stride)
         .def("channels", &Frame::channels)
         .def("mb_samples", &Frame::nb_samples)
+        .def("format", &Frame::format)
+        .def("str_pix_fmt", &Frame::str_pix_fmt)
+        .def("plane_count", &Frame::planes)
+        .def("plane", [](py::object self, int i) { return plane_array(self, i); })
+        .def("planes", [](py::object self) {
+            py::list result;
+            for (int i = 0; i < self.cast<Frame&>().planes(); i++)
+                result.append(plane_array(self, i));
+            return result;
+        })
+        .def("format_info", [](const Frame& f) {
+            py::dict info;
+            info["pix_fmt"] = f.str_pix_fmt();
+            info["planes"] = f.planes();
+            const AVPixFmtDescriptor* desc = f.is_null() ? nullptr : av_pix_fmt_desc_get((AVPixelFormat)f.format());
+            if (desc && f.width()) {
+                info["bit_depth"] = desc->comp[0].depth;
+                info["log2_chroma_w"] = desc->log2_chroma_w;
+                info["log2_chroma_h"] = desc->log2_chroma_h;
+                info["rgb"] = (bool)(desc->flags & AV_PIX_FMT_FLAG_RGB);
+                info["alpha"] = (bool)(desc->flags & AV_PIX_FMT_FLAG_ALPHA);
+                const char* space = av_color_space_name(f.frame->colorspace);
+                const char* range = av_color_range_name(f.frame->color_range);
+                info["color_space"] = space ? space : "unknown";
+                info["color_range"] = range ? range : "unknown";
+                info["full_range"] = f.frame->color_range == AVCOL_RANGE_JPEG || std::string(desc->name).rfind("yuvj", 0) == 0;
+            }
+            return info;
+        })
         .def_buffer([](Frame &m) -> py::buffer_info {
             if (m.height() == 0 && m.width() == 0) {
                 return py::buffer_info(
@@ -132,20 +285,288 @@ PYBIND11_MODULE(avio, m)
                 );
             }
             else {
-                py::ssize_t element_size = sizeof(uint8_t);
-                std::string fmt_desc =  py::format_descriptor<uint8_t>::format();
-                std::vector<py::ssize_t> dims = { m.height(), m.width(), 3};
-                py::ssize_t ndim = dims.size();
-                std::vector<py::ssize_t> strides = { (long)(sizeof(uint8_t) * m.stride()), (py::ssize_t)(sizeof(uint8_t) * ndim), sizeof(uint8_t) };
-                return py::buffer_info(m.data(), element_size, fmt_desc, ndim, dims, strides);
+                // the first plane, which is the whole image for packed formats like rgb24, grey or rgba
+                PlaneShape shape = m.plane(0);
+                if (!shape.rows)
+                    throw std::runtime_error("frame format " + m.str_pix_fmt() + " cannot be exported");
+                std::vector<py::ssize_t> dims = { shape.rows, shape.cols };
+                std::vector<py::ssize_t> strides = { m.stride(), (py::ssize_t)shape.element_size * shape.channels };
+                if (shape.channels > 1) {
+                    dims.push_back(shape.channels);
+                    strides.push_back(shape.element_size);
+                }
+                return py::buffer_info(m.data(), shape.element_size, plane_format(shape), dims.size(), dims, strides);
+            }
+        });
+
+    py::class_<TapEvent>(m, "TapEvent")
+        .def_readonly("name", &TapEvent::name)
+        .def_readonly("uri", &TapEvent::uri)
+        .def_readonly("value", &TapEvent::value)
+        .def_readonly("pts", &TapEvent::pts);
+
+    py::class_<Letterbox>(m, "Letterbox")
+        .def_readonly("scale", &Letterbox::scale)
+        .def_readonly("offset_x", &Letterbox::offset_x)
+        .def_readonly("offset_y", &Letterbox::offset_y)
+        .def_readonly("width", &Letterbox::width)
+        .def_readonly("height", &Letterbox::height)
+        .def_readonly("pts", &Letterbox::pts)
+        .def_readonly("valid", &Letterbox::valid);
+
+    py::class_<Batch>(m, "Batch", py::buffer_protocol())
+        .def(py::init<int, int, bool, int, int>(), py::arg("width")=640, py::arg("height")=640, py::arg("as_float")=true, py::arg("threads")=0, py::arg("capacity")=8)
+        .def("prepare", [](Batch& b, const std::vector<Player*>& players) {
+            std::vector<Frame> frames;
+            for (Player* player : players)
+                frames.push_back(player ? player->getLatestFrame() : Frame(nullptr));
+            b.prepare(frames);
+        }, py::call_guard<py::gil_scoped_release>())
+        .def("prepare", &Batch::prepare, py::call_guard<py::gil_scoped_release>())
+        .def("info", [](Batch& b) {
+            std::lock_guard<std::mutex> lock(b.mutex);
+            return b.info;
+        })
+        .def("set_normalization", &Batch::set_normalization)
+        .def("size", [](Batch& b) { return b.count; })
+        .def_readwrite("bgr", &Batch::bgr)
+        .def_readwrite("center", &Batch::center)
+        .def_readwrite("pad_value", &Batch::pad_value)
+        .def_buffer([](Batch &b) -> py::buffer_info {
+            // the memory is fixed for the life of the batch, but its contents are replaced by the next call to prepare
+            py::ssize_t element_size = b.element_size();
+            std::string fmt_desc = b.as_float ? py::format_descriptor<float>::format() : py::format_descriptor<uint8_t>::format();
+            std::vector<py::ssize_t> dims = { b.count, 3, b.height, b.width };
+            std::vector<py::ssize_t> strides = { (py::ssize_t)b.slot_size(), (py::ssize_t)(b.plane_size() * element_size), b.width * element_size, element_size };
+            return py::buffer_info(b.buffer.data(), element_size, fmt_desc, 4, dims, strides);
+        });
+
+    py::class_<Compositor>(m, "Compositor", py::buffer_protocol())
+        .def(py::init<int, int, int>(), py::arg("width"), py::arg("height"), py::arg("threads")=0)
+        .def("compose", [](Compositor& c, const std::vector<Player*>& players) {
+            std::vector<Frame> frames;
+            for (Player* player : players)
+                frames.push_back(player ? player->getLatestFrame() : Frame(nullptr));
+            return c.compose(frames);
+        }, py::call_guard<py::gil_scoped_release>())
+        .def("compose", &Compositor::compose, py::call_guard<py::gil_scoped_release>())
+        .def("set_layout", &Compositor::set_layout)
+        .def("resize", &Compositor::resize)
+        .def("set_background", &Compositor::set_background)
+        .def("dirty", &Compositor::dirty)
+        .def("dirty_rects", &Compositor::dirty_rects)
+        .def_readonly("width", &Compositor::width)
+        .def_readonly("height", &Compositor::height)
+        .def_readwrite("keep_aspect", &Compositor::keep_aspect)
+        .def_buffer([](Compositor& c) -> py::buffer_info {
+            std::vector<py::ssize_t> dims = { c.height, c.width, 3 };
+            std::vector<py::ssize_t> strides = { c.stride(), 3, 1 };
+            return py::buffer_info(c.canvas.data(), sizeof(uint8_t), py::format_descriptor<uint8_t>::format(), 3, dims, strides);
+        });
+
+    py::class_<Detect>(m, "Detect")
+        .def(py::init<int>(), py::arg("threads")=0)
+        .def("process", [](Detect& d, py::array_t<float, py::array::c_style | py::array::forcecast> outputs, const std::vector<Letterbox>& info) {
+            // returns one array per image with rows of x1, y1, x2, y2, score, label
+            if (outputs.ndim() != 3)
+                throw std::runtime_error("detector output must have shape [batch, anchors, 5 + classes]");
+            std::vector<std::vector<Detection>> result;
+            {
+                py::gil_scoped_release release;
+                result = d.process(outputs.data(), outputs.shape(0), outputs.shape(1), outputs.shape(2), info);
+            }
+            py::list images;
+            for (const std::vector<Detection>& list : result) {
+                py::array_t<float> boxes({ (py::ssize_t)list.size(), (py::ssize_t)6 });
+                float* p = boxes.mutable_data();
+                for (const Detection& det : list) {
+                    *p++ = det.x1; *p++ = det.y1; *p++ = det.x2; *p++ = det.y2;
+                    *p++ = det.score; *p++ = (float)det.label;
+                }
+                images.append(boxes);
+            }
+            return images;
+        }, py::arg("outputs"), py::arg("info")=std::vector<Letterbox>())
+        .def_readwrite("conf_threshold", &Detect::conf_threshold)
+        .def_readwrite("nms_threshold", &Detect::nms_threshold)
+        .def_readwrite("decode", &Detect::decode)
+        .def_readwrite("input_width", &Detect::input_width)
+        .def_readwrite("input_height", &Detect::input_height)
+        .def_readwrite("strides", &Detect::strides)
+        .def_readwrite("max_detections", &Detect::max_detections);
+
+    py::class_<Track>(m, "Track")
+        .def_readonly("id", &Track::id)
+        .def_readonly("label", &Track::label)
+        .def_readonly("score", &Track::score)
+        .def_readonly("hits", &Track::hits)
+        .def_readonly("misses", &Track::misses)
+        .def_property_readonly("x1", &Track::x1)
+        .def_property_readonly("y1", &Track::y1)
+        .def_property_readonly("x2", &Track::x2)
+        .def_property_readonly("y2", &Track::y2)
+        .def("dwell", &Track::dwell)
+        .def("uncertainty", &Track::uncertainty);
+
+    py::class_<Tracker>(m, "Tracker")
+        .def(py::init<>())
+        .def("predict", &Tracker::predict)
+        .def("needs_detection", &Tracker::needs_detection)
+        .def("update", [](Tracker& t, py::array_t<float, py::array::c_style | py::array::forcecast> boxes) {
+            // accepts the (n, 6) arrays returned by Detect.process
+            if (boxes.size() && (boxes.ndim() != 2 || boxes.shape(1) < 6))
+                throw std::runtime_error("tracker input must have rows of x1, y1, x2, y2, score, label");
+            std::vector<Detection> detections(boxes.size() ? boxes.shape(0) : 0);
+            const float* p = boxes.data();
+            for (Detection& d : detections) {
+                d.x1 = p[0]; d.y1 = p[1]; d.x2 = p[2]; d.y2 = p[3];
+                d.score = p[4]; d.label = (int)p[5];
+                p += boxes.shape(1);
+            }
+            t.update(detections);
+        })
+        .def("tracks", &Tracker::confirmed)
+        .def("counts", [](Tracker& t) {
+            std::lock_guard<std::mutex> lock(t.mutex);
+            return t.counts;
+        })
+        .def("reset", &Tracker::reset)
+        .def_readwrite("iou_threshold", &Tracker::iou_threshold)
+        .def_readwrite("min_hits", &Tracker::min_hits)
+        .def_readwrite("max_misses", &Tracker::max_misses)
+        .def_readwrite("min_interval", &Tracker::min_interval)
+        .def_readwrite("max_interval", &Tracker::max_interval)
+        .def_readwrite("max_uncertainty", &Tracker::max_uncertainty)
+        .def_readonly("detections_run", &Tracker::detections_run)
+        .def_readonly("frames_seen", &Tracker::frames_seen);
+
+    py::class_<Scheduler>(m, "Scheduler")
+        .def(py::init<float>(), py::arg("budget")=10.0f)
+        .def("next", [](Scheduler& s) -> py::object {
+            // returns a (uri, frame) tuple, or None once the scheduler is closed
+            std::string uri;
+            Frame f(nullptr);
+            bool result;
+            {
+                py::gil_scoped_release release;
+                result = s.next(uri, f);
             }
+            if (!result)
+                return py::none();
+            return py::make_tuple(uri, std::move(f));
+        })
+        .def("submit", &Scheduler::submit, py::call_guard<py::gil_scoped_release>())
+        .def("set_priority", &Scheduler::set_priority)
+        .def("remove", &Scheduler::remove)
+        .def("fps", &Scheduler::fps)
+        .def("rates", &Scheduler::rates)
+        .def("close", &Scheduler::close)
+        .def_readwrite("budget", &Scheduler::budget)
+        .def_readwrite("use_priority", &Scheduler::use_priority)
+        .def_readwrite("max_age_ms", &Scheduler::max_age_ms)
+        .def_readwrite("window_seconds", &Scheduler::window_seconds);
+
+    py::class_<Startup>(m, "Startup")
+        .def(py::init<int>(), py::arg("max_concurrent")=4)
+        .def("add", &Startup::add, py::arg("uri"), py::arg("priority")=0)
+        .def("remove", &Startup::remove)
+        .def("set_priority", &Startup::set_priority)
+        .def("cancel", &Startup::cancel)
+        .def("position", &Startup::position)
+        .def("timings", &Startup::timings)
+        .def_readwrite("max_concurrent", &Startup::max_concurrent)
+        .def_readwrite("max_attempts", &Startup::max_attempts)
+        .def_readwrite("backoff_ms", &Startup::backoff_ms)
+        .def_readwrite("max_backoff_ms", &Startup::max_backoff_ms)
+        .def_readwrite("jitter", &Startup::jitter);
+
+    py::class_<Restream>(m, "Restream")
+        .def(py::init<const std::string&>(), py::arg("address")="http://0.0.0.0:8554")
+        .def("add", &Restream::add)
+        .def("remove", &Restream::remove)
+        .def("start", &Restream::start)
+        .def("stop", &Restream::stop, py::call_guard<py::gil_scoped_release>())
+        .def("connections", &Restream::connections)
+        .def_readwrite("client_queue", &Restream::client_queue)
+        .def_readwrite("max_clients", &Restream::max_clients)
+        .def_readwrite("infoCallback", &Restream::infoCallback);
+
+    py::class_<SharedFrame>(m, "SharedFrame", py::buffer_protocol())
+        .def("is_null", &SharedFrame::is_null)
+        .def("valid", &SharedFrame::valid)
+        .def("str_format", &SharedFrame::str_format)
+        .def_readonly("sequence", &SharedFrame::sequence)
+        .def_readonly("pts", &SharedFrame::pts)
+        .def_readonly("time_us", &SharedFrame::time_us)
+        .def_readonly("width", &SharedFrame::width)
+        .def_readonly("height", &SharedFrame::height)
+        .def_readonly("size", &SharedFrame::size)
+        .def("plane", [](py::object self, int i) { return plane_array(self, self.cast<const SharedFrame&>(), i); })
+        .def("planes", [](py::object self) {
+            const SharedFrame& f = self.cast<const SharedFrame&>();
+            py::list result;
+            for (int i = 0; !f.is_null() && i < av_pix_fmt_count_planes((AVPixelFormat)f.format); i++)
+                result.append(plane_array(self, f, i));
+            return result;
+        })
+        .def_buffer([](SharedFrame& f) -> py::buffer_info {
+            // packed formats are shaped like a Frame, planar ones are the raw planes, see plane()
+            if (f.is_null())
+                return py::buffer_info((void*)nullptr, sizeof(uint8_t), py::format_descriptor<uint8_t>::format(), 1, { 0 }, { 1 }, true);
+            if (av_pix_fmt_count_planes((AVPixelFormat)f.format) == 1) {
+                PlaneShape shape = plane_shape(f.format, f.width, f.height, 0);
+                std::vector<py::ssize_t> dims = { shape.rows, shape.cols };
+                std::vector<py::ssize_t> strides = { f.linesize[0], (py::ssize_t)shape.element_size * shape.channels };
+                if (shape.channels > 1) {
+                    dims.push_back(shape.channels);
+                    strides.push_back(shape.element_size);
+                }
+                return py::buffer_info((void*)f.data[0], shape.element_size, plane_format(shape), dims.size(), dims, strides, true);
+            }
+            return py::buffer_info((void*)f.data[0], sizeof(uint8_t), py::format_descriptor<uint8_t>::format(), 1, { (py::ssize_t)f.size }, { 1 }, true);
         });
 
+    py::class_<FrameBusReader>(m, "FrameBusReader")
+        .def(py::init<const std::string&>())
+        .def("attached", &FrameBusReader::attached)
+        .def("latest", &FrameBusReader::latest)
+        .def("next", &FrameBusReader::next, py::arg("timeout_ms")=1000, py::call_guard<py::gil_scoped_release>())
+        .def_readonly("bus_name", &FrameBusReader::bus_name);
+
+    py::class_<StreamHint>(m, "StreamHint")
+        .def(py::init<>())
+        .def_readwrite("video_codec", &StreamHint::video_codec)
+        .def_readwrite("width", &StreamHint::width)
+        .def_readwrite("height", &StreamHint::height)
+        .def_readwrite("fps", &StreamHint::fps)
+        .def_readwrite("audio_codec", &StreamHint::audio_codec)
+        .def_readwrite("sample_rate", &StreamHint::sample_rate);
+
+    py::class_<Admission>(m, "Admission")
+        .def(py::init<>())
+        .def("add", &Admission::add, py::arg("uri"), py::arg("priority")=0)
+        .def("set_priority", &Admission::set_priority)
+        .def("remove", &Admission::remove)
+        .def("levels", &Admission::levels)
+        .def("cpu", [](const Admission& a) { return a.cpu.load(); })
+        .def_readwrite("max_cpu", &Admission::max_cpu)
+        .def_readwrite("min_cpu", &Admission::min_cpu)
+        .def_readwrite("max_queue", &Admission::max_queue)
+        .def_readwrite("interval_ms", &Admission::interval_ms);
+
     py::class_<AVRational>(m, "AVRational")
         .def(py::init<>())
         .def_readwrite("num", &AVRational::num)
         .def_readwrite("den", &AVRational::den);
 
+    m.def("hubStats", &Hub::snapshot);
+    m.def("forgetStreamParameters", &ParameterCache::forget);
+    m.def("clearStreamParameters", &ParameterCache::clear);
+    m.def("traceEnable", [](bool enable) { Trace::enabled = enable; });
+    m.def("traceClear", &Trace::clear);
+    m.def("traceJson", &Trace::json);
+    m.def("traceDump", &Trace::dump, py::call_guard<py::gil_scoped_release>());
+
     m.attr("__version__") = "3.2.7";
 
 }
@@ -0,0 +1,93 @@
+/********************************************************************
+* libavio/tests/admission_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <vector>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include "Admission.hpp"
+
+using namespace avio;
+
+static bool reference(const std::vector<uint8_t>& data, AVCodecID codec_id, int length_size=0) {
+    return is_reference(data.data(), (int)data.size(), codec_id, length_size);
+}
+
+TEST(NalReference, H264) {
+    uint8_t idr = 0x65, ref = 0x41, non_ref = 0x01, sps = 0x67, sei = 0x06;
+    EXPECT_EQ(nal_reference(&idr, 1, AV_CODEC_ID_H264), 1);
+    EXPECT_EQ(nal_reference(&ref, 1, AV_CODEC_ID_H264), 1);
+    EXPECT_EQ(nal_reference(&non_ref, 1, AV_CODEC_ID_H264), 0);
+    EXPECT_EQ(nal_reference(&sps, 1, AV_CODEC_ID_H264), -1);
+    EXPECT_EQ(nal_reference(&sei, 1, AV_CODEC_ID_H264), -1);
+    EXPECT_EQ(nal_reference(&idr, 0, AV_CODEC_ID_H264), -1);
+}
+
+TEST(NalReference, Hevc) {
+    // the type is in bits 1 to 6 of the first header byte
+    uint8_t trail_n = 0 << 1, trail_r = 1 << 1, rasl_n = 8 << 1, idr = 19 << 1, vps = 32 << 1;
+    EXPECT_EQ(nal_reference(&trail_n, 2, AV_CODEC_ID_HEVC), 0);
+    EXPECT_EQ(nal_reference(&trail_r, 2, AV_CODEC_ID_HEVC), 1);
+    EXPECT_EQ(nal_reference(&rasl_n, 2, AV_CODEC_ID_HEVC), 0);
+    EXPECT_EQ(nal_reference(&idr, 2, AV_CODEC_ID_HEVC), 1);
+    EXPECT_EQ(nal_reference(&vps, 2, AV_CODEC_ID_HEVC), -1);
+}
+
+TEST(IsReference, AnnexB) {
+    EXPECT_FALSE(reference({ 0, 0, 0, 1, 0x01, 0xaa, 0xbb }, AV_CODEC_ID_H264));
+    EXPECT_FALSE(reference({ 0, 0, 0, 1, 0x06, 0x05, 0, 0, 1, 0x01, 0xaa }, AV_CODEC_ID_H264));
+    EXPECT_TRUE(reference({ 0, 0, 0, 1, 0x01, 0xaa, 0, 0, 1, 0x41, 0xbb }, AV_CODEC_ID_H264));
+    EXPECT_TRUE(reference({ 0, 0, 0, 1, 0x67, 0x64, 0, 0, 1, 0x68, 0xee }, AV_CODEC_ID_H264));
+    EXPECT_FALSE(reference({ 0, 0, 1, 0x00, 0x01, 0xaa }, AV_CODEC_ID_HEVC));
+    EXPECT_TRUE(reference({ 0, 0, 1, 0x02, 0x01, 0xaa }, AV_CODEC_ID_HEVC));
+}
+
+TEST(IsReference, LengthPrefixed) {
+    EXPECT_FALSE(reference({ 0, 0, 0, 2, 0x01, 0xaa }, AV_CODEC_ID_H264, 4));
+    EXPECT_TRUE(reference({ 0, 0, 0, 2, 0x01, 0xaa, 0, 0, 0, 2, 0x41, 0xbb }, AV_CODEC_ID_H264, 4));
+    EXPECT_FALSE(reference({ 0, 2, 0x01, 0xaa }, AV_CODEC_ID_H264, 2));
+    // a length that runs past the packet ends the walk before any slice is seen
+    EXPECT_TRUE(reference({ 0, 0, 0, 9, 0x01, 0xaa }, AV_CODEC_ID_H264, 4));
+}
+
+TEST(IsReference, OtherCodecs) {
+    EXPECT_TRUE(reference({ 0, 0, 0, 1, 0x01, 0xaa }, AV_CODEC_ID_MJPEG));
+    EXPECT_TRUE(reference({}, AV_CODEC_ID_H264));
+}
+
+TEST(NalLengthSize, Extradata) {
+    AVCodecParameters* par = avcodec_parameters_alloc();
+    ASSERT_TRUE(par);
+    uint8_t avcc[7] = { 1, 0x64, 0, 0x28, 0xff, 0xe1, 0 };
+    uint8_t annexb[4] = { 0, 0, 0, 1 };
+    par->codec_id = AV_CODEC_ID_H264;
+    par->extradata = avcc;
+    par->extradata_size = sizeof(avcc);
+    EXPECT_EQ(nal_length_size(par), 4);
+    avcc[4] = 0xfd;
+    EXPECT_EQ(nal_length_size(par), 2);
+    par->extradata = annexb;
+    par->extradata_size = sizeof(annexb);
+    EXPECT_EQ(nal_length_size(par), 0);
+    par->extradata = nullptr;
+    par->extradata_size = 0;
+    EXPECT_EQ(nal_length_size(par), 0);
+    avcodec_parameters_free(&par);
+}
@@ -0,0 +1,206 @@
+/********************************************************************
+* libavio/tests/capture_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include "Capture.hpp"
+
+using namespace avio;
+
+// A video stream at 90 kHz and an audio stream at 48 kHz, with packets whose bytes all carry
+// the packet number so that the replayed data can be told apart.
+
+class CaptureTest : public ::testing::Test {
+protected:
+    std::string filename;
+    AVFormatContext* fmt_ctx = nullptr;
+
+    void SetUp() override {
+        filename = ::testing::TempDir() + "avio_capture_test.avcap";
+        fmt_ctx = avformat_alloc_context();
+        ASSERT_TRUE(fmt_ctx);
+
+        AVStream* video = avformat_new_stream(fmt_ctx, nullptr);
+        ASSERT_TRUE(video);
+        video->time_base = av_make_q(1, 90000);
+        video->avg_frame_rate = av_make_q(30, 1);
+        AVCodecParameters* par = video->codecpar;
+        par->codec_type = AVMEDIA_TYPE_VIDEO;
+        par->codec_id = AV_CODEC_ID_H264;
+        par->format = AV_PIX_FMT_YUV420P;
+        par->width = 1920;
+        par->height = 1080;
+        par->extradata = (uint8_t*)av_mallocz(5 + AV_INPUT_BUFFER_PADDING_SIZE);
+        ASSERT_TRUE(par->extradata);
+        par->extradata_size = 5;
+        memcpy(par->extradata, "\x01\x64\x00\x28\xff", 5);
+
+        AVStream* audio = avformat_new_stream(fmt_ctx, nullptr);
+        ASSERT_TRUE(audio);
+        audio->time_base = av_make_q(1, 48000);
+        par = audio->codecpar;
+        par->codec_type = AVMEDIA_TYPE_AUDIO;
+        par->codec_id = AV_CODEC_ID_AAC;
+        par->sample_rate = 48000;
+        av_channel_layout_from_mask(&par->ch_layout, AV_CH_LAYOUT_STEREO);
+    }
+
+    void TearDown() override {
+        avformat_free_context(fmt_ctx);
+        remove(filename.c_str());
+    }
+
+    void write(int count) {
+        Capture capture(filename, fmt_ctx);
+        AVPacket* pkt = av_packet_alloc();
+        for (int i = 0; i < count; i++) {
+            ASSERT_EQ(av_new_packet(pkt, 100 + i), 0);
+            memset(pkt->data, i, pkt->size);
+            bool video = i % 2 == 0;
+            pkt->stream_index = video ? 0 : 1;
+            pkt->pts = pkt->dts = video ? i / 2 * 3000 : i / 2 * 1600;
+            pkt->duration = video ? 3000 : 1600;
+            pkt->flags = i % 8 == 0 ? AV_PKT_FLAG_KEY : 0;
+            capture.write(pkt);
+            av_packet_unref(pkt);
+        }
+        av_packet_free(&pkt);
+        EXPECT_EQ(capture.packets, count);
+    }
+};
+
+TEST_F(CaptureTest, StreamParameters) {
+    write(0);
+    Replay replay(filename);
+    ASSERT_EQ(replay.streams.size(), 2u);
+    const AVCodecParameters* video = replay.streams[0].codecpar;
+    EXPECT_EQ(video->codec_type, AVMEDIA_TYPE_VIDEO);
+    EXPECT_EQ(video->codec_id, AV_CODEC_ID_H264);
+    EXPECT_EQ(video->width, 1920);
+    EXPECT_EQ(video->height, 1080);
+    ASSERT_EQ(video->extradata_size, 5);
+    EXPECT_EQ(memcmp(video->extradata, "\x01\x64\x00\x28\xff", 5), 0);
+    EXPECT_EQ(av_cmp_q(replay.streams[0].time_base, av_make_q(1, 90000)), 0);
+    EXPECT_EQ(av_cmp_q(replay.streams[0].avg_frame_rate, av_make_q(30, 1)), 0);
+
+    const AVCodecParameters* audio = replay.streams[1].codecpar;
+    EXPECT_EQ(audio->codec_id, AV_CODEC_ID_AAC);
+    EXPECT_EQ(audio->sample_rate, 48000);
+    EXPECT_EQ(audio->ch_layout.nb_channels, 2);
+    EXPECT_TRUE(replay.records.empty());
+    EXPECT_EQ(replay.start_time, AV_NOPTS_VALUE);
+}
+
+TEST_F(CaptureTest, RoundTrip) {
+    write(16);
+    Replay replay(filename);
+    ASSERT_EQ(replay.records.size(), 16u);
+    EXPECT_EQ(replay.start_time, 0);
+    // the last video packet starts at 7 * 3000 and lasts 3000 ticks of 90 kHz
+    EXPECT_EQ(replay.duration, av_rescale_q(8 * 3000, av_make_q(1, 90000), AV_TIME_BASE_Q));
+
+    AVPacket* pkt = av_packet_alloc();
+    for (int i = 0; i < 16; i++) {
+        ASSERT_EQ(replay.read(pkt, false), 0);
+        bool video = i % 2 == 0;
+        EXPECT_EQ(pkt->stream_index, video ? 0 : 1);
+        EXPECT_EQ(pkt->pts, video ? i / 2 * 3000 : i / 2 * 1600);
+        EXPECT_EQ(pkt->dts, pkt->pts);
+        EXPECT_EQ(pkt->duration, video ? 3000 : 1600);
+        EXPECT_EQ(pkt->flags, i % 8 == 0 ? AV_PKT_FLAG_KEY : 0);
+        ASSERT_EQ(pkt->size, 100 + i);
+        EXPECT_EQ(pkt->data[0], i);
+        EXPECT_EQ(pkt->data[pkt->size - 1], i);
+        av_packet_unref(pkt);
+    }
+    EXPECT_EQ(replay.read(pkt, false), AVERROR_EOF);
+
+    replay.rewind();
+    ASSERT_EQ(replay.read(pkt, false), 0);
+    EXPECT_EQ(pkt->data[0], 0);
+    EXPECT_EQ(replay.loops, 1);
+    av_packet_unref(pkt);
+    av_packet_free(&pkt);
+}
+
+TEST_F(CaptureTest, Seek) {
+    write(16);
+    Replay replay(filename);
+    AVPacket* pkt = av_packet_alloc();
+    // key frames are packets 0 and 8, the video of packet 8 is at pts 12000
+    replay.seek(0, 15000);
+    ASSERT_EQ(replay.read(pkt, false), 0);
+    EXPECT_EQ(pkt->pts, 12000);
+    EXPECT_TRUE(pkt->flags & AV_PKT_FLAG_KEY);
+    av_packet_unref(pkt);
+    replay.seek(0, 11999);
+    ASSERT_EQ(replay.read(pkt, false), 0);
+    EXPECT_EQ(pkt->pts, 0);
+    av_packet_unref(pkt);
+    av_packet_free(&pkt);
+}
+
+TEST_F(CaptureTest, TruncatedFile) {
+    // a capture cut short keeps every packet that was written in full
+    write(16);
+    std::ifstream in(filename, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size() - 10);
+    out.close();
+
+    Replay replay(filename);
+    EXPECT_EQ(replay.records.size(), 15u);
+}
+
+TEST_F(CaptureTest, Context) {
+    write(4);
+    Replay replay(filename);
+    AVFormatContext* ctx = replay.context();
+    ASSERT_EQ(ctx->nb_streams, 2u);
+    EXPECT_EQ(ctx->streams[0]->codecpar->width, 1920);
+    EXPECT_EQ(ctx->streams[0]->codecpar->extradata_size, 5);
+    EXPECT_EQ(av_cmp_q(ctx->streams[1]->time_base, av_make_q(1, 48000)), 0);
+    EXPECT_EQ(ctx->start_time, 0);
+    avformat_free_context(ctx);
+}
+
+TEST_F(CaptureTest, AbortedPacedRead) {
+    write(4);
+    Replay replay(filename);
+    AVPacket* pkt = av_packet_alloc();
+    replay.aborted = true;
+    EXPECT_EQ(replay.read(pkt, true), AVERROR_EXIT);
+    av_packet_free(&pkt);
+}
+
+TEST(CaptureFile, NotACapture) {
+    std::string filename = ::testing::TempDir() + "avio_not_a_capture.avcap";
+    std::ofstream(filename, std::ios::binary) << "not a capture file";
+    EXPECT_THROW(Replay replay(filename), std::runtime_error);
+    remove(filename.c_str());
+    EXPECT_THROW(Replay replay(filename), std::runtime_error);
+}
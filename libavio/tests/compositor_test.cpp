@@ -0,0 +1,144 @@
+/********************************************************************
+* libavio/tests/compositor_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <vector>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "Compositor.hpp"
+
+using namespace avio;
+
+// A 100 x 50 canvas split into two square tiles, fed with mid gray frames. The first stream is
+// 4:3, so it is letterboxed in its tile, and the second is square.
+
+static Frame make_frame(int width, int height, int64_t pts) {
+    Frame f;
+    f.frame->format = AV_PIX_FMT_YUV420P;
+    f.frame->width = width;
+    f.frame->height = height;
+    f.frame->pts = pts;
+    EXPECT_EQ(av_frame_get_buffer(f.frame, 0), 0);
+    memset(f.frame->data[0], 128, (size_t)f.frame->linesize[0] * height);
+    memset(f.frame->data[1], 128, (size_t)f.frame->linesize[1] * ((height + 1) / 2));
+    memset(f.frame->data[2], 128, (size_t)f.frame->linesize[2] * ((height + 1) / 2));
+    return f;
+}
+
+static std::vector<Frame> frames(const Frame& a, const Frame& b) {
+    std::vector<Frame> result;
+    result.push_back(a.is_null() ? Frame(nullptr) : Frame(a));
+    result.push_back(b.is_null() ? Frame(nullptr) : Frame(b));
+    return result;
+}
+
+class CompositorTest : public ::testing::Test {
+protected:
+    Compositor compositor { 100, 50, 2 };
+    Frame a = make_frame(64, 48, 1);
+    Frame b = make_frame(64, 64, 1);
+    Frame none { nullptr };
+
+    void SetUp() override {
+        compositor.set_layout({ { 0, 0, 50, 50 }, { 50, 0, 50, 50 } });
+    }
+
+    const uint8_t* pixel(int x, int y) {
+        return compositor.canvas.data() + (size_t)y * compositor.stride() + x * 3;
+    }
+};
+
+TEST_F(CompositorTest, FirstComposeDrawsEverything) {
+    EXPECT_EQ(compositor.compose(frames(a, none)), 2);
+    EXPECT_EQ(compositor.dirty(), std::vector<int>({ 0, 1 }));
+    EXPECT_EQ(compositor.dirty_rects(), std::vector<std::vector<int>>({ { 0, 0, 100, 50 } }));
+    EXPECT_NEAR(pixel(25, 25)[0], 130, 5);
+    EXPECT_EQ(pixel(75, 25)[0], 0);
+}
+
+TEST_F(CompositorTest, UnchangedFramesAreSkipped) {
+    compositor.compose(frames(a, b));
+    EXPECT_EQ(compositor.compose(frames(a, b)), 0);
+    EXPECT_TRUE(compositor.dirty().empty());
+    EXPECT_TRUE(compositor.dirty_rects().empty());
+}
+
+TEST_F(CompositorTest, NewFrameDrawsItsTile) {
+    compositor.compose(frames(a, b));
+    b.frame->pts = 2;
+    EXPECT_EQ(compositor.compose(frames(a, b)), 1);
+    EXPECT_EQ(compositor.dirty(), std::vector<int>({ 1 }));
+    EXPECT_EQ(compositor.dirty_rects(), std::vector<std::vector<int>>({ { 50, 0, 50, 50 } }));
+
+    // a stream that stops is cleared once
+    EXPECT_EQ(compositor.compose(frames(a, none)), 1);
+    EXPECT_EQ(pixel(75, 25)[0], 0);
+    EXPECT_EQ(compositor.compose(frames(a, none)), 0);
+}
+
+TEST_F(CompositorTest, LayoutChange) {
+    compositor.compose(frames(a, b));
+    compositor.set_layout({ { 0, 0, 50, 50 }, { 50, 0, 50, 50 } });
+    EXPECT_EQ(compositor.compose(frames(a, b)), 0);
+
+    compositor.set_layout({ { 0, 0, 50, 50 }, { 60, 10, 30, 30 } });
+    EXPECT_EQ(compositor.compose(frames(a, b)), 1);
+    EXPECT_EQ(compositor.dirty(), std::vector<int>({ 1 }));
+    // the old rectangle was repainted, so the whole canvas has to be shown
+    EXPECT_EQ(compositor.dirty_rects(), std::vector<std::vector<int>>({ { 0, 0, 100, 50 } }));
+    EXPECT_EQ(pixel(52, 2)[0], 0);
+    EXPECT_NEAR(pixel(75, 25)[0], 130, 5);
+
+    compositor.set_layout({ { 0, 0, 50, 50 } });
+    EXPECT_EQ(compositor.compose(frames(a, b)), 0);
+    EXPECT_EQ(pixel(75, 25)[0], 0);
+}
+
+TEST_F(CompositorTest, ResizeClampsAndRedraws) {
+    compositor.compose(frames(a, b));
+    compositor.resize(40, 20);
+    EXPECT_EQ(compositor.tiles[0].width, 40);
+    EXPECT_EQ(compositor.tiles[0].height, 20);
+    EXPECT_EQ(compositor.tiles[1].x, 40);
+    EXPECT_EQ(compositor.tiles[1].width, 0);
+    EXPECT_EQ(compositor.compose(frames(a, b)), 2);
+
+    // the requested layout comes back when there is room for it again
+    compositor.resize(100, 50);
+    EXPECT_EQ(compositor.tiles[1].x, 50);
+    EXPECT_EQ(compositor.tiles[1].width, 50);
+    EXPECT_EQ(compositor.compose(frames(a, b)), 2);
+    EXPECT_NEAR(pixel(75, 25)[0], 130, 5);
+}
+
+TEST_F(CompositorTest, Background) {
+    compositor.compose(frames(a, none));
+    compositor.set_background(0, 0, 255);
+    EXPECT_EQ(compositor.compose(frames(a, none)), 2);
+    EXPECT_EQ(pixel(75, 25)[2], 255);
+    // the frame is letterboxed inside its square tile
+    EXPECT_EQ(pixel(25, 0)[2], 255);
+}
+
+TEST(Compositor, InvalidArguments) {
+    EXPECT_THROW(Compositor(0, 10), std::runtime_error);
+    Compositor compositor(10, 10);
+    EXPECT_THROW(compositor.set_layout({ { 0, 0, 10 } }), std::runtime_error);
+}
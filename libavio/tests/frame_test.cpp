@@ -0,0 +1,89 @@
+/********************************************************************
+* libavio/tests/frame_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "Frame.hpp"
+
+using namespace avio;
+
+static void expect_shape(AVPixelFormat format, int width, int height, int plane, int rows, int cols, int channels, int element_size) {
+    PlaneShape s = plane_shape(format, width, height, plane);
+    SCOPED_TRACE(std::string(av_get_pix_fmt_name(format)) + " plane " + std::to_string(plane));
+    EXPECT_EQ(s.rows, rows);
+    EXPECT_EQ(s.cols, cols);
+    EXPECT_EQ(s.channels, channels);
+    EXPECT_EQ(s.element_size, element_size);
+    EXPECT_FALSE(s.is_float);
+}
+
+TEST(PlaneShape, Planar) {
+    expect_shape(AV_PIX_FMT_YUV420P, 640, 480, 0, 480, 640, 1, 1);
+    expect_shape(AV_PIX_FMT_YUV420P, 640, 480, 1, 240, 320, 1, 1);
+    expect_shape(AV_PIX_FMT_YUV420P, 640, 480, 2, 240, 320, 1, 1);
+    // odd sizes round the chroma up
+    expect_shape(AV_PIX_FMT_YUV420P, 641, 481, 1, 241, 321, 1, 1);
+}
+
+TEST(PlaneShape, InterleavedChroma) {
+    expect_shape(AV_PIX_FMT_NV12, 640, 480, 0, 480, 640, 1, 1);
+    expect_shape(AV_PIX_FMT_NV12, 640, 480, 1, 240, 320, 2, 1);
+}
+
+TEST(PlaneShape, Packed) {
+    expect_shape(AV_PIX_FMT_RGB24, 640, 480, 0, 480, 640, 3, 1);
+    expect_shape(AV_PIX_FMT_RGBA, 640, 480, 0, 480, 640, 4, 1);
+}
+
+TEST(PlaneShape, HighBitDepth) {
+    expect_shape(AV_PIX_FMT_YUV420P10LE, 640, 480, 0, 480, 640, 1, 2);
+    expect_shape(AV_PIX_FMT_YUV420P10LE, 640, 480, 1, 240, 320, 1, 2);
+}
+
+TEST(PlaneShape, IrregularPlanesAreBytes) {
+    // yuyv422 alternates luma and chroma samples of different steps in one plane
+    expect_shape(AV_PIX_FMT_YUYV422, 640, 480, 0, 480, 1280, 1, 1);
+}
+
+TEST(PlaneShape, Invalid) {
+    for (int plane : { -1, 3 }) {
+        PlaneShape s = plane_shape(AV_PIX_FMT_YUV420P, 640, 480, plane);
+        EXPECT_EQ(s.rows, 0);
+        EXPECT_EQ(s.cols, 0);
+    }
+    PlaneShape s = plane_shape(AV_PIX_FMT_NV12, 640, 480, 2);
+    EXPECT_EQ(s.rows, 0);
+    s = plane_shape(AV_PIX_FMT_CUDA, 640, 480, 0);
+    EXPECT_EQ(s.rows, 0);
+    s = plane_shape(AV_PIX_FMT_NONE, 640, 480, 0);
+    EXPECT_EQ(s.rows, 0);
+}
+
+TEST(Frame, Planes) {
+    Frame f;
+    EXPECT_EQ(f.planes(), 0);
+    f.frame->format = AV_PIX_FMT_NV12;
+    f.frame->width = 64;
+    f.frame->height = 48;
+    ASSERT_EQ(av_frame_get_buffer(f.frame, 0), 0);
+    EXPECT_EQ(f.planes(), 2);
+    EXPECT_EQ(f.plane(1).rows, 24);
+    EXPECT_EQ(f.plane(1).channels, 2);
+    EXPECT_EQ(f.str_pix_fmt(), "nv12");
+}
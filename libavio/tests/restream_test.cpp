@@ -0,0 +1,200 @@
+/********************************************************************
+* libavio/tests/restream_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "Capture.hpp"
+#include "Restream.hpp"
+
+using namespace avio;
+
+// A capture of an h264 stream with a key frame every 10 packets, replayed in a loop by a hub
+// and served by a restream server on the loopback interface. The packets are written 5 ms
+// apart, so the replay is paced at 200 packets a second.
+
+static const std::string address = "http://127.0.0.1:18554";
+
+static std::vector<uint8_t> fetch(const std::string& url, int size) {
+    // the first bytes of the response body, empty if the request was refused
+    std::vector<uint8_t> result;
+    AVIOContext* io = nullptr;
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "rw_timeout", "5000000", 0);
+    int ret = avio_open2(&io, url.c_str(), AVIO_FLAG_READ, nullptr, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return result;
+    result.resize(size);
+    ret = avio_read(io, result.data(), size);
+    result.resize(ret > 0 ? ret : 0);
+    avio_closep(&io);
+    return result;
+}
+
+static std::vector<std::string> boxes(const std::vector<uint8_t>& data) {
+    // types of the complete top level boxes
+    std::vector<std::string> result;
+    size_t pos = 0;
+    while (pos + 8 <= data.size()) {
+        uint32_t size = (uint32_t)data[pos] << 24 | data[pos + 1] << 16 | data[pos + 2] << 8 | data[pos + 3];
+        if (size < 8 || pos + size > data.size())
+            break;
+        result.push_back(std::string((const char*)&data[pos + 4], 4));
+        pos += size;
+    }
+    return result;
+}
+
+class RestreamTest : public ::testing::Test {
+protected:
+    std::string filename;
+    std::shared_ptr<Hub> hub;
+    Restream restream { address };
+
+    void SetUp() override {
+        filename = ::testing::TempDir() + "avio_restream_test.avcap";
+        write(60);
+        // the server finds this hub in the registry, so its clients share the looping replay
+        ReaderOptions options;
+        options.realtime = true;
+        options.loop = true;
+        hub = Hub::open(filename, "", options);
+        restream.add("/front", filename);
+        restream.start();
+    }
+
+    void TearDown() override {
+        restream.stop();
+        hub.reset();
+        remove(filename.c_str());
+    }
+
+    void write(int count) {
+        AVFormatContext* fmt_ctx = avformat_alloc_context();
+        ASSERT_TRUE(fmt_ctx);
+        AVStream* video = avformat_new_stream(fmt_ctx, nullptr);
+        ASSERT_TRUE(video);
+        video->time_base = av_make_q(1, 90000);
+        video->avg_frame_rate = av_make_q(30, 1);
+        AVCodecParameters* par = video->codecpar;
+        par->codec_type = AVMEDIA_TYPE_VIDEO;
+        par->codec_id = AV_CODEC_ID_H264;
+        par->format = AV_PIX_FMT_YUV420P;
+        par->width = 640;
+        par->height = 480;
+        // an avcC record with one sps and one pps, the mp4 muxer copies it into the sample description
+        static const uint8_t avcc[] = { 0x01, 0x42, 0xc0, 0x1e, 0xff, 0xe1, 0x00, 0x04, 0x67, 0x42, 0xc0, 0x1e,
+                                        0x01, 0x00, 0x04, 0x68, 0xce, 0x3c, 0x80 };
+        par->extradata = (uint8_t*)av_mallocz(sizeof(avcc) + AV_INPUT_BUFFER_PADDING_SIZE);
+        ASSERT_TRUE(par->extradata);
+        par->extradata_size = sizeof(avcc);
+        memcpy(par->extradata, avcc, sizeof(avcc));
+
+        Capture capture(filename, fmt_ctx);
+        AVPacket* pkt = av_packet_alloc();
+        for (int i = 0; i < count; i++) {
+            // one length prefixed nal unit, an idr slice on key frames
+            bool key = i % 10 == 0;
+            ASSERT_EQ(av_new_packet(pkt, 1000), 0);
+            memset(pkt->data, 0x55, pkt->size);
+            pkt->data[0] = 0;
+            pkt->data[1] = 0;
+            pkt->data[2] = (pkt->size - 4) >> 8;
+            pkt->data[3] = (pkt->size - 4) & 0xff;
+            pkt->data[4] = key ? 0x65 : 0x41;
+            pkt->pts = pkt->dts = i * 3000;
+            pkt->duration = 3000;
+            pkt->flags = key ? AV_PKT_FLAG_KEY : 0;
+            capture.write(pkt);
+            av_packet_unref(pkt);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        av_packet_free(&pkt);
+        avformat_free_context(fmt_ctx);
+    }
+};
+
+TEST_F(RestreamTest, InitSegmentAndFragments) {
+    std::vector<std::string> types = boxes(fetch(address + "/front", 64 * 1024));
+    ASSERT_GE(types.size(), 4u);
+    EXPECT_EQ(types[0], "ftyp");
+    EXPECT_EQ(types[1], "moov");
+    // a fragment starts at every key frame, each is a moof followed by its mdat
+    int fragments = 0;
+    for (size_t i = 2; i + 1 < types.size(); i += 2) {
+        EXPECT_EQ(types[i], "moof");
+        EXPECT_EQ(types[i + 1], "mdat");
+        fragments++;
+    }
+    EXPECT_GE(fragments, 2);
+    EXPECT_FALSE(restream.connections().empty());
+}
+
+static size_t cached(Hub& hub, bool& full) {
+    std::lock_guard<std::mutex> lock(hub.mutex);
+    full = hub.gop_full;
+    return hub.gop.size();
+}
+
+TEST_F(RestreamTest, PrimingFitsTheQueue) {
+    // the cached gop goes into a primed queue on top of its capacity, so none of it is dropped
+    std::shared_ptr<HubSubscriber> first = hub->attach("first", 4, DROP_TO_KEY_FRAME, true);
+    bool full = false;
+    while (cached(*hub, full) < 6)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::shared_ptr<HubSubscriber> second = hub->attach("second", 4, DROP_TO_KEY_FRAME, true);
+    EXPECT_FALSE(second->truncated);
+    EXPECT_GT(second->delivered.load(), 0);
+    EXPECT_EQ(second->dropped.load(), 0);
+    Packet p = second->pkts.pop();
+    EXPECT_TRUE(p.is_key_frame());
+    hub->detach(first);
+    hub->detach(second);
+}
+
+TEST_F(RestreamTest, LongGopIsNotPrimed) {
+    // a gop cut short by max_gop would decode with a gap, the subscriber waits for the next key frame
+    {
+        std::lock_guard<std::mutex> lock(hub->mutex);
+        hub->max_gop = 3;
+    }
+    std::shared_ptr<HubSubscriber> first = hub->attach("first", 4, DROP_TO_KEY_FRAME, true);
+    bool full = false;
+    while (cached(*hub, full), !full)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::shared_ptr<HubSubscriber> second = hub->attach("second", 4, DROP_TO_KEY_FRAME, true);
+    EXPECT_TRUE(second->truncated);
+    hub->detach(first);
+    hub->detach(second);
+
+    // the cache is dropped with the last primed subscriber
+    EXPECT_EQ(cached(*hub, full), 0u);
+}
+
+TEST_F(RestreamTest, UnknownPathIsRefused) {
+    EXPECT_TRUE(fetch(address + "/missing", 16).empty());
+}
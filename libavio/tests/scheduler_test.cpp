@@ -0,0 +1,142 @@
+/********************************************************************
+* libavio/tests/scheduler_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "Scheduler.hpp"
+
+using namespace avio;
+
+static Frame make_frame() {
+    Frame f;
+    f.frame->format = AV_PIX_FMT_GRAY8;
+    f.frame->width = 16;
+    f.frame->height = 16;
+    EXPECT_EQ(av_frame_get_buffer(f.frame, 0), 0);
+    return f;
+}
+
+TEST(Scheduler, RoundRobin) {
+    Scheduler scheduler(0);
+    Frame f = make_frame();
+    std::string uri;
+    Frame out(nullptr);
+    std::vector<std::string> order;
+    for (int round = 0; round < 2; round++) {
+        for (const char* camera : { "a", "b", "c" })
+            scheduler.submit(camera, f);
+        for (int i = 0; i < 3; i++) {
+            ASSERT_TRUE(scheduler.next(uri, out));
+            EXPECT_FALSE(out.is_null());
+            order.push_back(uri);
+        }
+    }
+    // every camera is served once before any is served again
+    for (int i = 3; i < 6; i++)
+        EXPECT_NE(std::find(order.begin(), order.begin() + 3, order[i]), order.begin() + 3);
+    EXPECT_EQ(order[3], order[0]);
+}
+
+TEST(Scheduler, Priority) {
+    Scheduler scheduler(0);
+    scheduler.use_priority = true;
+    scheduler.set_priority("b", 5);
+    Frame f = make_frame();
+    for (const char* camera : { "a", "b", "c" })
+        scheduler.submit(camera, f);
+    std::string uri;
+    Frame out(nullptr);
+    ASSERT_TRUE(scheduler.next(uri, out));
+    EXPECT_EQ(uri, "b");
+}
+
+TEST(Scheduler, NewerFrameReplacesPending) {
+    Scheduler scheduler(0);
+    Frame f = make_frame();
+    f.frame->pts = 1;
+    scheduler.submit("a", f);
+    f.frame->pts = 2;
+    scheduler.submit("a", f);
+    std::string uri;
+    Frame out(nullptr);
+    ASSERT_TRUE(scheduler.next(uri, out));
+    EXPECT_EQ(out.pts(), 2);
+    EXPECT_EQ(scheduler.slots["a"].dropped, 1);
+    EXPECT_EQ(scheduler.slots["a"].analyzed, 1);
+}
+
+TEST(Scheduler, StaleFramesAreDropped) {
+    Scheduler scheduler(0);
+    scheduler.max_age_ms = 10;
+    scheduler.submit("a", make_frame());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::lock_guard<std::mutex> lock(scheduler.mutex);
+    EXPECT_EQ(scheduler.select(std::chrono::steady_clock::now()), nullptr);
+    EXPECT_EQ(scheduler.slots["a"].dropped, 1);
+}
+
+TEST(Scheduler, CloseReleasesWorkers) {
+    Scheduler scheduler(10);
+    std::thread worker([&] {
+        std::string uri;
+        Frame out(nullptr);
+        EXPECT_FALSE(scheduler.next(uri, out));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    scheduler.close();
+    worker.join();
+}
+
+TEST(Scheduler, BudgetIsShared) {
+    // three cameras at 30 fps under a budget of 15 fps get 5 fps each
+    Scheduler scheduler(15);
+    Frame f = make_frame();
+    std::atomic<bool> running { true };
+    std::thread cameras([&] {
+        while (running) {
+            for (const char* camera : { "a", "b", "c" })
+                scheduler.submit(camera, f);
+            std::this_thread::sleep_for(std::chrono::milliseconds(33));
+        }
+    });
+    std::thread worker([&] {
+        std::string uri;
+        Frame out(nullptr);
+        while (scheduler.next(uri, out)) { }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    std::map<std::string, float> rates = scheduler.rates();
+    running = false;
+    scheduler.close();
+    cameras.join();
+    worker.join();
+
+    ASSERT_EQ(rates.size(), 3u);
+    for (auto& [uri, fps] : rates)
+        EXPECT_NEAR(fps, 5.0f, 1.0f) << uri;
+}
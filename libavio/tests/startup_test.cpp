@@ -0,0 +1,229 @@
+/********************************************************************
+* libavio/tests/startup_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "Startup.hpp"
+
+using namespace avio;
+
+static void wait_queued(Startup& startup, int handle) {
+    while (startup.position(handle) < 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static int64_t ms_since(int64_t start_us) {
+    return (steady_us() - start_us) / 1000;
+}
+
+TEST(Startup, PriorityThenOldestFirst) {
+    Startup startup(1);
+    int holder = startup.add("rtsp://holder");
+    ASSERT_TRUE(startup.acquire(holder));
+
+    int low = startup.add("rtsp://low", 0);
+    int high = startup.add("rtsp://high", 5);
+    int later = startup.add("rtsp://later", 0);
+
+    std::vector<int> order;
+    std::mutex order_mutex;
+    std::vector<std::thread> threads;
+    for (int handle : { low, high, later }) {
+        threads.emplace_back([&, handle] {
+            if (!startup.acquire(handle)) return;
+            {
+                std::lock_guard<std::mutex> lock(order_mutex);
+                order.push_back(handle);
+            }
+            startup.ready(handle);
+        });
+        wait_queued(startup, handle);
+    }
+
+    EXPECT_EQ(startup.position(high), 0);
+    EXPECT_EQ(startup.position(low), 1);
+    EXPECT_EQ(startup.position(later), 2);
+    EXPECT_EQ(startup.position(holder), -1);
+
+    startup.ready(holder);
+    for (std::thread& t : threads)
+        t.join();
+    EXPECT_EQ(order, std::vector<int>({ high, low, later }));
+    EXPECT_EQ(startup.active, 0);
+}
+
+TEST(Startup, ConcurrencyLimit) {
+    Startup startup(2);
+    int a = startup.add("rtsp://a");
+    int b = startup.add("rtsp://b");
+    int c = startup.add("rtsp://c");
+    ASSERT_TRUE(startup.acquire(a));
+    ASSERT_TRUE(startup.acquire(b));
+
+    std::thread waiting([&] { EXPECT_TRUE(startup.acquire(c)); });
+    wait_queued(startup, c);
+    EXPECT_EQ(startup.active, 2);
+
+    // a stream removed while it holds a slot gives the slot back
+    startup.remove(a);
+    waiting.join();
+    EXPECT_EQ(startup.timings(c)["state"], STARTUP_OPENING);
+    startup.ready(b);
+    startup.ready(c);
+    EXPECT_EQ(startup.active, 0);
+}
+
+TEST(Startup, ExponentialBackoff) {
+    Startup startup(1);
+    startup.backoff_ms = 50;
+    startup.jitter = 0.0f;
+    startup.max_attempts = 3;
+    int handle = startup.add("rtsp://camera");
+
+    ASSERT_TRUE(startup.acquire(handle));
+    int64_t failed_us = steady_us();
+    ASSERT_TRUE(startup.failed(handle, "connection refused"));
+    EXPECT_EQ(startup.position(handle), -1);
+
+    // the slot is free for other streams during the backoff
+    int other = startup.add("rtsp://other");
+    ASSERT_TRUE(startup.acquire(other));
+    startup.ready(other);
+
+    ASSERT_TRUE(startup.acquire(handle, true));
+    EXPECT_GE(ms_since(failed_us), 50);
+    failed_us = steady_us();
+    ASSERT_TRUE(startup.failed(handle, "connection refused"));
+    ASSERT_TRUE(startup.acquire(handle, true));
+    EXPECT_GE(ms_since(failed_us), 100);
+    EXPECT_EQ(startup.timings(handle)["attempts"], 3);
+
+    // the last attempt gives up
+    EXPECT_FALSE(startup.failed(handle, "connection refused"));
+    EXPECT_EQ(startup.timings(handle)["state"], STARTUP_FAILED);
+    EXPECT_EQ(startup.entries[handle].error, "connection refused");
+    EXPECT_EQ(startup.active, 0);
+}
+
+TEST(Startup, BackoffIsCapped) {
+    Startup startup(1);
+    startup.backoff_ms = 1000;
+    startup.max_backoff_ms = 50;
+    startup.jitter = 0.0f;
+    int handle = startup.add("rtsp://camera");
+    ASSERT_TRUE(startup.acquire(handle));
+    ASSERT_TRUE(startup.failed(handle, "timeout"));
+    int64_t delay_ms = (startup.entries[handle].next_attempt_us - steady_us()) / 1000;
+    EXPECT_LE(delay_ms, 50);
+}
+
+TEST(Startup, CancelWhileQueued) {
+    Startup startup(1);
+    int holder = startup.add("rtsp://holder");
+    int handle = startup.add("rtsp://camera");
+    ASSERT_TRUE(startup.acquire(holder));
+
+    std::thread waiting([&] { EXPECT_FALSE(startup.acquire(handle)); });
+    wait_queued(startup, handle);
+    startup.cancel(handle);
+    waiting.join();
+    EXPECT_EQ(startup.timings(handle)["state"], STARTUP_CANCELLED);
+}
+
+TEST(Startup, CancelDuringBackoff) {
+    // a cancel that arrives between a failed attempt and the retry is not lost
+    Startup startup(1);
+    startup.backoff_ms = 10;
+    int handle = startup.add("rtsp://camera");
+    ASSERT_TRUE(startup.acquire(handle));
+    ASSERT_TRUE(startup.failed(handle, "timeout"));
+    startup.cancel(handle);
+    EXPECT_FALSE(startup.acquire(handle, true));
+    EXPECT_EQ(startup.active, 0);
+
+    // nor is it reset by a fresh acquire, a new start queues again under a new handle
+    EXPECT_FALSE(startup.acquire(handle));
+    startup.remove(handle);
+    handle = startup.add("rtsp://camera");
+    EXPECT_TRUE(startup.acquire(handle));
+    EXPECT_EQ(startup.timings(handle)["attempts"], 1);
+    startup.release(handle);
+    EXPECT_EQ(startup.active, 0);
+}
+
+TEST(Startup, CancelBeforeFirstAcquire) {
+    // a player terminated before its play thread reached the queue does not open
+    Startup startup(1);
+    int handle = startup.add("rtsp://camera");
+    startup.cancel(handle);
+    EXPECT_FALSE(startup.acquire(handle));
+    EXPECT_EQ(startup.timings(handle)["state"], STARTUP_CANCELLED);
+    EXPECT_EQ(startup.active, 0);
+}
+
+TEST(Startup, CancelWhileOpening) {
+    // a player terminated during the open keeps its slot until the open returns, and is not retried
+    Startup startup(1);
+    int handle = startup.add("rtsp://camera");
+    ASSERT_TRUE(startup.acquire(handle));
+    startup.cancel(handle);
+    EXPECT_EQ(startup.timings(handle)["state"], STARTUP_OPENING);
+    EXPECT_EQ(startup.active, 1);
+    EXPECT_FALSE(startup.failed(handle, "timeout"));
+    EXPECT_EQ(startup.timings(handle)["state"], STARTUP_CANCELLED);
+    EXPECT_EQ(startup.active, 0);
+    EXPECT_FALSE(startup.acquire(handle, true));
+
+    // an open that succeeds is given back by release and ends cancelled
+    int other = startup.add("rtsp://other");
+    ASSERT_TRUE(startup.acquire(other));
+    startup.cancel(other);
+    startup.release(other);
+    EXPECT_EQ(startup.timings(other)["state"], STARTUP_CANCELLED);
+    EXPECT_EQ(startup.active, 0);
+}
+
+TEST(Startup, RemoveWhileWaiting) {
+    // a player destroyed while it waits for its turn wakes the waiting thread
+    Startup startup(1);
+    int holder = startup.add("rtsp://holder");
+    int handle = startup.add("rtsp://camera");
+    ASSERT_TRUE(startup.acquire(holder));
+
+    std::thread waiting([&] { EXPECT_FALSE(startup.acquire(handle)); });
+    wait_queued(startup, handle);
+    startup.remove(handle);
+    waiting.join();
+    EXPECT_EQ(startup.position(handle), -1);
+    startup.ready(holder);
+    EXPECT_EQ(startup.active, 0);
+}
+
+TEST(Startup, UnknownHandle) {
+    Startup startup(1);
+    EXPECT_FALSE(startup.acquire(42));
+    EXPECT_FALSE(startup.failed(42, "error"));
+    EXPECT_TRUE(startup.timings(42).empty());
+    EXPECT_EQ(startup.position(42), -1);
+}
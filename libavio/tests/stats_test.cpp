@@ -0,0 +1,86 @@
+/********************************************************************
+* libavio/tests/stats_test.cpp
+*
+* Copyright (c) 2025  Stephen Rhodes
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*********************************************************************/
+
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include "Stats.hpp"
+
+using namespace avio;
+
+TEST(Histogram, EmptyIsZero) {
+    Histogram h;
+    EXPECT_EQ(h.percentile(50), 0);
+    EXPECT_EQ(h.percentile(99), 0);
+}
+
+TEST(Histogram, BucketsCoverTheirValues) {
+    for (uint64_t v : { 0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull, 1000ull, 33333ull, 1ull << 30 }) {
+        int i = Histogram::bucket(v);
+        EXPECT_LE(Histogram::lower_bound(i), v) << v;
+        EXPECT_GT(Histogram::lower_bound(i + 1), v) << v;
+    }
+    EXPECT_EQ(Histogram::bucket(UINT64_MAX), Histogram::SIZE - 1);
+}
+
+TEST(Histogram, SmallValuesAreExact) {
+    Histogram h;
+    for (int i = 0; i < 10; i++)
+        h.record(3);
+    EXPECT_EQ(h.percentile(50), 3);
+    EXPECT_EQ(h.percentile(100), 3);
+}
+
+TEST(Histogram, PercentilesWithinBucketError) {
+    Histogram h;
+    for (int64_t v = 1; v <= 10000; v++)
+        h.record(v * 100);
+    for (double pct : { 50.0, 90.0, 99.0 }) {
+        double expected = pct * 10000;
+        EXPECT_NEAR((double)h.percentile(pct), expected, expected / 16) << pct;
+    }
+    EXPECT_EQ(h.max.load(), 1000000);
+}
+
+TEST(Histogram, PercentileFollowsRank) {
+    // 90 fast samples and 10 slow ones, the tail is only seen from p91 up
+    Histogram h;
+    for (int i = 0; i < 90; i++) h.record(1000);
+    for (int i = 0; i < 10; i++) h.record(50000);
+    EXPECT_NEAR((double)h.percentile(50), 1000, 1000 / 16.0);
+    EXPECT_NEAR((double)h.percentile(90), 1000, 1000 / 16.0);
+    EXPECT_NEAR((double)h.percentile(91), 50000, 50000 / 16.0);
+}
+
+TEST(Histogram, NegativeValuesCountAsZero) {
+    Histogram h;
+    h.record(-5);
+    EXPECT_EQ(h.total.load(), 1);
+    EXPECT_EQ(h.percentile(50), 0);
+}
+
+TEST(Histogram, Reset) {
+    Histogram h;
+    h.record(500);
+    h.reset();
+    EXPECT_EQ(h.total.load(), 0);
+    EXPECT_EQ(h.max.load(), 0);
+    EXPECT_EQ(h.percentile(50), 0);
+}